@@ -0,0 +1,723 @@
+/**
+ * @file benchmarks.cpp
+ * @brief Микробенчмарки TTaskScheduler на Google Benchmark.
+ *
+ * Сборка: цель `benchmarks` создаётся, если в системе найден пакет benchmark.
+ * Запуск: `./benchmarks --benchmark_filter=Sweep`.
+ */
+
+#include "task_scheduler.hpp"
+#include "parallel_algorithms.hpp"
+#include "graph_compiler.hpp"
+#include "quadratic_kernels.hpp"
+#include "quadratic_graph.hpp"
+#include <benchmark/benchmark.h>
+#include <vector>
+#include <cmath>
+#include <sys/resource.h>
+#include <malloc.h>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+// operator new поверх malloc с подсчётом выделений (BM_AllocationTrackingOverhead).
+TASK_SCHEDULER_COUNT_ALLOCATIONS()
+
+/* -------------------- Сканирование статусов задач -------------------- */
+
+// Худший случай для executeAll: вычислено всё, кроме последней задачи.
+static void BM_SweepBitset(benchmark::State& state) {
+  const size_t n = static_cast<size_t>(state.range(0));
+  TaskBitset bits;
+  bits.resize(n);
+  for (size_t i = 0; i + 1 < n; ++i) bits.set(i);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(bits.findNextUnset(0));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(n / 8));
+}
+BENCHMARK(BM_SweepBitset)->Arg(1 << 20)->Arg(100'000'000)->Unit(benchmark::kMillisecond);
+
+// Для сравнения: тот же обход по bool на задачу (прежнее поле Task::evaluated).
+static void BM_SweepBoolPerTask(benchmark::State& state) {
+  const size_t n = static_cast<size_t>(state.range(0));
+  std::vector<unsigned char> bytes(n, 1);
+  bytes[n - 1] = 0;
+
+  for (auto _ : state) {
+    size_t i = 0;
+    while (i < n && bytes[i]) ++i;
+    benchmark::DoNotOptimize(i);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(n));
+}
+BENCHMARK(BM_SweepBoolPerTask)->Arg(1 << 20)->Arg(100'000'000)->Unit(benchmark::kMillisecond);
+
+static void BM_BitsetClear(benchmark::State& state) {
+  const size_t n = static_cast<size_t>(state.range(0));
+  TaskBitset bits;
+  bits.resize(n);
+
+  for (auto _ : state) {
+    bits.clear();
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(n / 8));
+}
+BENCHMARK(BM_BitsetClear)->Arg(100'000'000)->Unit(benchmark::kMillisecond);
+
+/* -------------------- executeAll -------------------- */
+
+// Повторный executeAll() по уже полностью вычисленному графу.
+static void BM_ExecuteAllSweepEvaluated(benchmark::State& state) {
+  const size_t n = static_cast<size_t>(state.range(0));
+  TTaskScheduler sched;
+  for (size_t i = 0; i < n; ++i) sched.add([]() { return 1; });
+  sched.executeAll();
+
+  for (auto _ : state) {
+    sched.executeAll();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(n));
+}
+BENCHMARK(BM_ExecuteAllSweepEvaluated)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+// Небольшая порция add() и executeAll() поверх большого уже вычисленного графа.
+static void BM_ExecuteAllAfterSmallBatch(benchmark::State& state) {
+  const size_t n = static_cast<size_t>(state.range(0));
+  TTaskScheduler sched;
+  for (size_t i = 0; i < n; ++i) sched.add([]() { return 1; });
+  sched.executeAll();
+
+  size_t last = n - 1;
+  for (auto _ : state) {
+    for (int k = 0; k < 16; ++k) {
+      last = sched.add([](int x) { return x + 1; }, sched.getFutureResult<int>(last));
+    }
+    sched.executeAll();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * 16);
+}
+BENCHMARK(BM_ExecuteAllAfterSmallBatch)->Arg(1 << 16)->Arg(1 << 22);
+
+/* -------------------- Параллельная ленивая оценка -------------------- */
+
+static double heavyWork(int iterations) {
+  double acc = 0.0;
+  for (int i = 1; i <= iterations; ++i) acc += std::sqrt(static_cast<double>(i));
+  return acc;
+}
+
+// Цель с двумя тяжёлыми независимыми входами: threads = 0 — последовательно.
+static void BM_GetResultTwoHeavyInputs(benchmark::State& state) {
+  const size_t threads = static_cast<size_t>(state.range(0));
+  for (auto _ : state) {
+    TTaskScheduler sched(threads);
+    auto a = sched.add([]() { return heavyWork(2'000'000); });
+    auto b = sched.add([]() { return heavyWork(2'000'000); });
+    auto c = sched.add([](double x, double y) { return x + y; },
+                       sched.getFutureResult<double>(a), sched.getFutureResult<double>(b));
+    benchmark::DoNotOptimize(sched.getResult<double>(c));
+  }
+}
+BENCHMARK(BM_GetResultTwoHeavyInputs)->Arg(0)->Arg(2)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/* -------------------- Пакетный getResults -------------------- */
+
+static void buildFanOut(TTaskScheduler& sched, std::vector<size_t>& ids, size_t n) {
+  auto base = sched.add([]() { return 1; });
+  for (size_t k = 0; k < n; ++k) {
+    ids.push_back(sched.add([](int b, int k) { return b + k; }, sched.getFutureResult<int>(base), static_cast<int>(k)));
+  }
+}
+
+static void BM_GetResultLoop(benchmark::State& state) {
+  const size_t n = static_cast<size_t>(state.range(0));
+  TTaskScheduler sched;
+  std::vector<size_t> ids;
+  buildFanOut(sched, ids, n);
+  sched.executeAll();
+  std::vector<int> out(n);
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i) out[i] = sched.getResult<int>(ids[i]);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(n));
+}
+BENCHMARK(BM_GetResultLoop)->Arg(512);
+
+static void BM_GetResultsBatch(benchmark::State& state) {
+  const size_t n = static_cast<size_t>(state.range(0));
+  TTaskScheduler sched;
+  std::vector<size_t> ids;
+  buildFanOut(sched, ids, n);
+  sched.executeAll();
+  std::vector<int> out(n);
+
+  for (auto _ : state) {
+    sched.getResults<int>(ids, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(n));
+}
+BENCHMARK(BM_GetResultsBatch)->Arg(512);
+
+/* -------------------- Конкурентный add() -------------------- */
+
+static TTaskScheduler* gSharedSched = nullptr;
+
+static void SetupSharedSched(const benchmark::State&) { gSharedSched = new TTaskScheduler(); }
+static void TeardownSharedSched(const benchmark::State&) {
+  delete gSharedSched;
+  gSharedSched = nullptr;
+}
+
+// Каждый поток-продюсер добавляет короткие цепочки в общий шедулер.
+static void BM_ConcurrentAdd(benchmark::State& state) {
+  for (auto _ : state) {
+    size_t prev = gSharedSched->add([]() { return 1; });
+    for (int k = 0; k < 63; ++k) {
+      prev = gSharedSched->add([](int x) { return x + 1; }, gSharedSched->getFutureResult<int>(prev));
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * 64);
+}
+BENCHMARK(BM_ConcurrentAdd)
+    ->Setup(SetupSharedSched)
+    ->Teardown(TeardownSharedSched)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+
+/* -------------------- Пул буферов результатов -------------------- */
+
+static long minorFaults() {
+  rusage ru{};
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_minflt;
+}
+
+// Конвейер из 4 производителей по 64 МБ и суммирующих потребителей, который
+// прогоняется заново после reset(). Arg(1) — буферы из пула, Arg(0) — новые.
+static void BM_PipelineRerun(benchmark::State& state) {
+  const bool pooled = state.range(0) != 0;
+  constexpr size_t kElems = size_t(8) << 20;
+  TTaskScheduler sched;
+
+  std::vector<size_t> sums;
+  for (int p = 0; p < 4; ++p) {
+    auto produce = sched.add([pooled](BufferHandle pool, double seed) {
+      std::vector<double> v = pooled ? pool.acquire<double>(kElems) : std::vector<double>(kElems);
+      for (size_t i = 0; i < v.size(); i += 512) v[i] = seed;
+      return v;
+    }, sched.buffers(), static_cast<double>(p));
+    sums.push_back(sched.add([](const std::vector<double>& v) { return v[0] + v[512]; },
+                             sched.getFutureResult<std::vector<double>>(produce)));
+  }
+  std::vector<double> out(sums.size());
+  sched.getResults<double>(sums, out);
+
+  long faults = 0;
+  for (auto _ : state) {
+    sched.reset();
+    long before = minorFaults();
+    sched.getResults<double>(sums, out);
+    faults += minorFaults() - before;
+  }
+  state.counters["faults_per_run"] = benchmark::Counter(static_cast<double>(faults), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_PipelineRerun)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+/* -------------------- Поточно-локальные аллокаторы -------------------- */
+
+// Множество мелких задач на пуле: каждая строит временный вектор и возвращает
+// небольшую структуру, потребители собирают результаты. Arg(1) — ThreadCache,
+// Arg(0) — глобальный operator new; второй аргумент — число потоков.
+static void BM_ParallelSmallResults(benchmark::State& state) {
+  ThreadCache::setEnabled(state.range(0) != 0);
+  constexpr size_t kTasks = 4096;
+  struct Small { double a, b, c, d; };
+
+  for (auto _ : state) {
+    TTaskScheduler sched(static_cast<size_t>(state.range(1)));
+    std::vector<size_t> leaves;
+    leaves.reserve(kTasks);
+    for (size_t i = 0; i < kTasks; ++i) {
+      leaves.push_back(sched.add([](double x) {
+        std::vector<double, CachedAllocator<double>> scratch(16, x);
+        return Small{scratch[0], scratch[5], scratch[10], scratch[15]};
+      }, static_cast<double>(i)));
+    }
+    for (size_t i = 0; i + 1 < kTasks; i += 2) {
+      sched.add([](const Small& l, const Small& r) { return l.a + r.d; },
+                sched.getFutureResult<Small>(leaves[i]), sched.getFutureResult<Small>(leaves[i + 1]));
+    }
+    sched.executeAll();
+    benchmark::DoNotOptimize(sched);
+  }
+  ThreadCache::setEnabled(true);
+  state.SetItemsProcessed(state.iterations() * kTasks * 3 / 2);
+}
+BENCHMARK(BM_ParallelSmallResults)
+    ->Args({0, 4})->Args({1, 4})->Args({0, 0})->Args({1, 0})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/* -------------------- Память на задачу -------------------- */
+
+static size_t heapInUse() {
+  struct mallinfo2 mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+}
+
+// Байты кучи на задачу для графа из цепочек: у каждой задачи зависимость и
+// аргумент-значение. Соберите с -DTASK_SCHEDULER_COMPACT_IDS=ON для 32-битных id.
+static void BM_PerTaskMemory(benchmark::State& state) {
+  const size_t n = static_cast<size_t>(state.range(0));
+  double perTask = 0;
+  for (auto _ : state) {
+    const size_t before = heapInUse();
+    auto sched = std::make_unique<TTaskScheduler>();
+    size_t prev = sched->add([] { return 0.0; });
+    for (size_t i = 1; i < n; ++i) {
+      prev = sched->add([](double x, double k) { return x + k; },
+                        sched->getFutureResult<double>(prev), 1.0);
+    }
+    perTask = static_cast<double>(heapInUse() - before) / static_cast<double>(n);
+    state.PauseTiming();
+    sched.reset();
+    state.ResumeTiming();
+  }
+  state.counters["bytes_per_task"] = perTask;
+}
+BENCHMARK(BM_PerTaskMemory)->Arg(1 << 20)->Arg(1 << 24)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+/* -------------------- Общие аргументы-значения -------------------- */
+
+// 256 задач читают одну таблицу на 4 МБ. Arg(0) — таблица копируется в каждую
+// задачу, Arg(1) — share(), Arg(2) — borrow().
+static void BM_AddLargeLiteral(benchmark::State& state) {
+  const std::vector<double> table(size_t(512) << 10, 1.0);
+  const auto shared = share(table);
+  constexpr size_t kTasks = 256;
+
+  for (auto _ : state) {
+    TTaskScheduler sched;
+    auto use = [](const std::vector<double>& t, size_t i) { return t[i]; };
+    for (size_t i = 0; i < kTasks; ++i) {
+      if (state.range(0) == 0) sched.add(use, table, i);
+      else if (state.range(0) == 1) sched.add(use, shared, i);
+      else sched.add(use, borrow(table), i);
+    }
+    sched.executeAll();
+    benchmark::DoNotOptimize(sched);
+  }
+  state.SetItemsProcessed(state.iterations() * kTasks);
+}
+BENCHMARK(BM_AddLargeLiteral)->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMillisecond);
+
+/* -------------------- Пересчёт вместо хранения -------------------- */
+
+// Цепочка из 64 задач, каждая строит вектор на 1 МБ из предыдущего.
+// Arg(1) — промежуточные результаты пересчитываемые, Arg(0) — хранятся все.
+static void BM_RematerializeChain(benchmark::State& state) {
+  constexpr size_t kLen = 64;
+  constexpr size_t kElems = size_t(128) << 10;
+  size_t resident = 0;
+
+  for (auto _ : state) {
+    TTaskScheduler sched;
+    size_t prev = sched.add([] { return std::vector<double>(kElems, 1.0); });
+    for (size_t i = 1; i < kLen; ++i) {
+      if (state.range(0) != 0) sched.markRematerializable(prev);
+      prev = sched.add([](const std::vector<double>& v) {
+        std::vector<double> out(v.size());
+        for (size_t j = 0; j < v.size(); ++j) out[j] = v[j] * 0.5 + 1.0;
+        return out;
+      }, sched.getFutureResult<std::vector<double>>(prev));
+    }
+    sched.executeAll();
+    resident = sched.stats().residentBytes;
+  }
+  state.counters["resident_MB"] = static_cast<double>(resident) / (1 << 20);
+}
+BENCHMARK(BM_RematerializeChain)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+/* -------------------- Спекулятивное выполнение -------------------- */
+
+// Задержка getResult после паузы, за которую свободные потоки успевают вычислить
+// чистую цепочку из 8 тяжёлых задач. Arg(1) — спекуляция включена.
+static void BM_GetResultAfterIdle(benchmark::State& state) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    TTaskScheduler sched(2);
+    size_t prev = sched.add([] { return heavyWork(500'000); });
+    sched.markPure(prev);
+    for (int i = 1; i < 8; ++i) {
+      prev = sched.add([](double x) { return x + heavyWork(500'000); }, sched.getFutureResult<double>(prev));
+      sched.markPure(prev);
+    }
+    sched.declareOutput(prev);
+    if (state.range(0) != 0) sched.enableSpeculation();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    state.ResumeTiming();
+
+    benchmark::DoNotOptimize(sched.getResult<double>(prev));
+  }
+}
+BENCHMARK(BM_GetResultAfterIdle)->Arg(0)->Arg(1)->Iterations(20)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/* -------------------- Модель стоимости -------------------- */
+
+// Цель ждёт цепочку из 4 тяжёлых задач и 12 независимых задач средней
+// стоимости; пул из 2 потоков. Arg(1) — модель обучена прошлым прогоном, и
+// цепочка критического пути стартует первой; Arg(0) — модель пуста.
+static void BM_CriticalPathPriority(benchmark::State& state) {
+  TTaskScheduler sched(2);
+  size_t chain = sched.add([] { return heavyWork(400'000); });
+  sched.setKind(chain, "bench.heavy");
+  for (int i = 1; i < 4; ++i) {
+    chain = sched.add([](double x) { return x + heavyWork(400'000); }, sched.getFutureResult<double>(chain));
+    sched.setKind(chain, "bench.heavy");
+  }
+  size_t acc = chain;
+  for (int i = 0; i < 12; ++i) {
+    auto side = sched.add([] { return heavyWork(200'000); });
+    sched.setKind(side, "bench.side");
+    acc = sched.add([](double x, double y) { return x + y; },
+                    sched.getFutureResult<double>(acc), sched.getFutureResult<double>(side));
+  }
+  if (state.range(0) != 0) {
+    sched.learnCosts();
+    sched.getResult<double>(acc);
+    sched.learnCosts(false);
+  }
+
+  for (auto _ : state) {
+    sched.reset();
+    benchmark::DoNotOptimize(sched.getResult<double>(acc));
+  }
+}
+BENCHMARK(BM_CriticalPathPriority)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// 4096 крошечных задач на пуле: с обученной моделью координатор выполняет их
+// сам вместо передачи в пул.
+static void BM_TinyTasksOnPool(benchmark::State& state) {
+  TTaskScheduler sched(2);
+  std::vector<size_t> ids;
+  for (int i = 0; i < 4096; ++i) ids.push_back(sched.add([](int x) { return x + 1; }, i));
+  std::vector<int> out(ids.size());
+  if (state.range(0) != 0) {
+    sched.learnCosts();
+    sched.getResults<int>(ids, out);
+    sched.learnCosts(false);
+  }
+
+  for (auto _ : state) {
+    sched.reset();
+    sched.getResults<int>(ids, out);
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(ids.size()));
+}
+BENCHMARK(BM_TinyTasksOnPool)->Arg(0)->Arg(1)->UseRealTime();
+
+/* -------------------- explain() -------------------- */
+
+// Стоимость оценки конуса из n задач (бинарное дерево сумм) без его выполнения.
+static void BM_ExplainCone(benchmark::State& state) {
+  const size_t n = static_cast<size_t>(state.range(0));
+  TTaskScheduler sched;
+  std::vector<size_t> level;
+  for (size_t i = 0; i < n; ++i) level.push_back(sched.add([](size_t x) { return static_cast<double>(x); }, i));
+  while (level.size() > 1) {
+    std::vector<size_t> next;
+    for (size_t i = 0; i + 1 < level.size(); i += 2) {
+      next.push_back(sched.add([](double x, double y) { return x + y; },
+                               sched.getFutureResult<double>(level[i]), sched.getFutureResult<double>(level[i + 1])));
+    }
+    if (level.size() % 2) next.push_back(level.back());
+    level.swap(next);
+  }
+
+  for (auto _ : state) benchmark::DoNotOptimize(sched.explain(level[0]));
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(2 * n));
+}
+BENCHMARK(BM_ExplainCone)->Arg(1 << 10)->Arg(1 << 16)->Unit(benchmark::kMicrosecond);
+
+/* -------------------- Гистограммы задержек -------------------- */
+
+// Цена замера задержек на крошечных задачах: Arg — setLatencySampling
+// (0 — выключено, 64 — каждая 64-я задача, 1 — все).
+static void BM_LatencySamplingOverhead(benchmark::State& state) {
+  TTaskScheduler sched;
+  sched.setLatencySampling(static_cast<uint32_t>(state.range(0)));
+  size_t prev = sched.add([] { return 0; });
+  for (int i = 1; i < 4096; ++i) prev = sched.add([](int x) { return x + 1; }, sched.getFutureResult<int>(prev));
+
+  for (auto _ : state) {
+    sched.reset();
+    sched.executeAll();
+  }
+  state.SetItemsProcessed(state.iterations() * 4096);
+}
+BENCHMARK(BM_LatencySamplingOverhead)->Arg(0)->Arg(64)->Arg(1);
+
+/* -------------------- Подсчёт выделений памяти -------------------- */
+
+// Цена setAllocationTracking на крошечных задачах: Arg — 0 выключено, 1 включено.
+static void BM_AllocationTrackingOverhead(benchmark::State& state) {
+  TTaskScheduler sched;
+  sched.setAllocationTracking(state.range(0) != 0);
+  size_t prev = sched.add([] { return 0; });
+  for (int i = 1; i < 4096; ++i) prev = sched.add([](int x) { return x + 1; }, sched.getFutureResult<int>(prev));
+
+  for (auto _ : state) {
+    sched.reset();
+    sched.executeAll();
+  }
+  state.SetItemsProcessed(state.iterations() * 4096);
+  state.counters["allocs"] = static_cast<double>(sched.stats().allocations);
+}
+BENCHMARK(BM_AllocationTrackingOverhead)->Arg(0)->Arg(1);
+
+/* -------------------- Снимки метрик -------------------- */
+
+// Цена наблюдения для вычисления на пуле: Arg 0 — метрики выключены,
+// 1 — включены без наблюдателя, 2 — отдельный поток снимает metrics() раз в миллисекунду.
+static void BM_MetricsScrapeOverhead(benchmark::State& state) {
+  TTaskScheduler sched(2);
+  if (state.range(0) > 0) sched.enableMetrics();
+  std::vector<size_t> leaves;
+  for (int i = 0; i < 256; ++i) leaves.push_back(sched.add([i] {
+    double x = i;
+    for (int k = 0; k < 2000; ++k) x = std::sqrt(x + k);
+    return x;
+  }));
+  size_t total = leaves[0];
+  for (size_t i = 1; i < leaves.size(); ++i) {
+    total = sched.add([](double a, double b) { return a + b; },
+                      sched.getFutureResult<double>(total), sched.getFutureResult<double>(leaves[i]));
+  }
+
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> scrapes{0};
+  std::thread scraper;
+  if (state.range(0) == 2) {
+    scraper = std::thread([&] {
+      while (!stop.load()) {
+        benchmark::DoNotOptimize(sched.metrics());
+        scrapes.fetch_add(1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+  }
+  for (auto _ : state) {
+    sched.reset();
+    benchmark::DoNotOptimize(sched.getResult<double>(total));
+  }
+  stop = true;
+  if (scraper.joinable()) scraper.join();
+  state.SetItemsProcessed(state.iterations() * 511);
+  state.counters["scrapes"] = static_cast<double>(scrapes.load());
+}
+BENCHMARK(BM_MetricsScrapeOverhead)->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+/* -------------------- Подграфы -------------------- */
+
+// 256 блоков по 8 задач, построение графа и вычисление. Arg 0 — задачи блоков
+// добавляются в родителя напрямую, 1 — каждый блок — экземпляр одного Subgraph.
+// На таких крошечных задачах разница — постоянная цена экземпляра (свой
+// шедулер и массив задач по размеру тела), а не тела.
+static void BM_SubgraphInstances(benchmark::State& state) {
+  constexpr int kBlocks = 256, kBlockTasks = 8;
+  auto step = [](int x) { return x * 3 + 1; };
+  const Subgraph<int(int)> block([step](TTaskScheduler& g, FutureResult<int> in) {
+    size_t last = g.add(step, in);
+    for (int k = 1; k < kBlockTasks; ++k) last = g.add(step, g.getFutureResult<int>(last));
+    return last;
+  });
+
+  for (auto _ : state) {
+    TTaskScheduler sched;
+    for (int b = 0; b < kBlocks; ++b) {
+      if (state.range(0) == 0) {
+        size_t last = sched.add(step, b);
+        for (int k = 1; k < kBlockTasks; ++k) last = sched.add(step, sched.getFutureResult<int>(last));
+      } else {
+        sched.add(block, b);
+      }
+    }
+    sched.executeAll();
+  }
+  state.SetItemsProcessed(state.iterations() * kBlocks * kBlockTasks);
+}
+BENCHMARK(BM_SubgraphInstances)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+/* -------------------- Циклы FixedPoint -------------------- */
+
+// Arg итераций Ньютона для x^2 - 2: Arg2 0 — цикл развёрнут в цепочку add()
+// по 4 задачи на итерацию, 1 — FixedPoint с тем же числом итераций.
+static void BM_FixedPointVsUnrolled(benchmark::State& state) {
+  const int iterations = static_cast<int>(state.range(0));
+  auto f = [](double x) { return x * x - 2; };
+  auto df = [](double x) { return 2 * x; };
+  auto ratio = [](double y, double d) { return y / d; };
+  auto update = [](double x, double r) { return x - r; };
+  const FixedPoint<double> loop(
+      [&](TTaskScheduler& g, FutureResult<double> x) {
+        const auto r = g.add(ratio, g.getFutureResult<double>(g.add(f, x)), g.getFutureResult<double>(g.add(df, x)));
+        return g.add(update, x, g.getFutureResult<double>(r));
+      },
+      [](double, double) { return false; }, static_cast<size_t>(iterations));
+
+  for (auto _ : state) {
+    TTaskScheduler sched;
+    size_t x = sched.add([] { return 1.0; });
+    if (state.range(1) == 0) {
+      for (int i = 0; i < iterations; ++i) {
+        const auto fx = sched.add(f, sched.getFutureResult<double>(x));
+        const auto dfx = sched.add(df, sched.getFutureResult<double>(x));
+        const auto r = sched.add(ratio, sched.getFutureResult<double>(fx), sched.getFutureResult<double>(dfx));
+        x = sched.add(update, sched.getFutureResult<double>(x), sched.getFutureResult<double>(r));
+      }
+    } else {
+      x = sched.add(loop, sched.getFutureResult<double>(x));
+    }
+    benchmark::DoNotOptimize(sched.getResult<double>(x));
+  }
+  state.SetItemsProcessed(state.iterations() * iterations);
+}
+BENCHMARK(BM_FixedPointVsUnrolled)->ArgsProduct({{16, 1024}, {0, 1}})->Unit(benchmark::kMicrosecond);
+
+/* -------------------- Параллельные алгоритмы -------------------- */
+
+// Узлы parallel_algorithms.hpp против последовательных std:: на 4M элементов.
+// Arg 0 — std::, 1 — узел в шедулере с пулом по числу ядер (минимум 2).
+// Узел берёт буферы из sched.buffers() и возвращает их при reset(), поэтому
+// сравнение с std:: на заранее выделенном буфере честное.
+static const std::vector<uint32_t>& algorithmInput() {
+  static const std::vector<uint32_t> data = [] {
+    std::vector<uint32_t> v(size_t(1) << 22);
+    std::mt19937 rng(1);
+    for (auto& x : v) x = rng();
+    return v;
+  }();
+  return data;
+}
+
+template<typename Node>
+static void runAlgorithmNode(benchmark::State& state, Node node) {
+  using Out = std::invoke_result_t<const Node&, const std::vector<uint32_t>&>;
+  TTaskScheduler sched(std::max(2u, std::thread::hardware_concurrency()));
+  if constexpr (requires { node.buffers; }) node.buffers = sched.buffers();
+  const auto out = sched.add(node, borrow(algorithmInput()));
+  const auto probe = sched.add([](const Out& r) { return sizeof(r); }, sched.getFutureResult<Out>(out));
+  for (auto _ : state) {
+    sched.reset();
+    benchmark::DoNotOptimize(sched.getResult<size_t>(probe));
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(algorithmInput().size()));
+}
+
+static void BM_AlgorithmScan(benchmark::State& state) {
+  const auto& in = algorithmInput();
+  if (state.range(0) == 1) {
+    return runAlgorithmNode(state, ParallelScan<uint32_t>{});
+  }
+  std::vector<uint32_t> out(in.size());
+  for (auto _ : state) {
+    std::inclusive_scan(in.begin(), in.end(), out.begin());
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(in.size()));
+}
+BENCHMARK(BM_AlgorithmScan)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Arg 0 — std::sort, 1 — std::stable_sort, 2 — ParallelSort, 3 — ParallelRadixSort.
+static void BM_AlgorithmSort(benchmark::State& state) {
+  const auto& in = algorithmInput();
+  if (state.range(0) == 2) return runAlgorithmNode(state, ParallelSort<uint32_t>{});
+  if (state.range(0) == 3) return runAlgorithmNode(state, ParallelRadixSort<uint32_t>{});
+  std::vector<uint32_t> out(in.size());
+  for (auto _ : state) {
+    std::copy(in.begin(), in.end(), out.begin());
+    if (state.range(0) == 0) {
+      std::sort(out.begin(), out.end());
+    } else {
+      std::stable_sort(out.begin(), out.end());
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(in.size()));
+}
+BENCHMARK(BM_AlgorithmSort)->DenseRange(0, 3)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_AlgorithmHistogram(benchmark::State& state) {
+  auto key = [](uint32_t x) { return static_cast<size_t>(x >> 22); };  // 1024 корзины
+  const auto& in = algorithmInput();
+  if (state.range(0) == 1) return runAlgorithmNode(state, ParallelHistogram<uint32_t, decltype(key)>{.bins = 1024});
+  std::vector<uint64_t> counts(1024);
+  for (auto _ : state) {
+    std::fill(counts.begin(), counts.end(), 0);
+    for (uint32_t x : in) ++counts[key(x)];
+    benchmark::DoNotOptimize(counts.data());
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(in.size()));
+}
+BENCHMARK(BM_AlgorithmHistogram)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_AlgorithmPartition(benchmark::State& state) {
+  auto odd = [](uint32_t x) { return (x & 1) != 0; };
+  const auto& in = algorithmInput();
+  if (state.range(0) == 1) return runAlgorithmNode(state, StablePartition<uint32_t, decltype(odd)>{});
+  std::vector<uint32_t> out(in.size());
+  for (auto _ : state) {
+    std::copy(in.begin(), in.end(), out.begin());
+    benchmark::DoNotOptimize(std::stable_partition(out.begin(), out.end(), odd));
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(in.size()));
+}
+BENCHMARK(BM_AlgorithmPartition)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/* -------------------- Граф, скомпилированный graphc -------------------- */
+
+// 256 экземпляров quadratic.graph с разными коэффициентами, построение и
+// вычисление. Arg 0 — описание выполняется в шедулере через KernelRegistry
+// (10 задач на экземпляр), 1 — сгенерированный код как одна задача на
+// экземпляр, 2 — сгенерированная функция без шедулера. На одном ядре порядка
+// 4 мкс, 0,2 мкс и единиц наносекунд на экземпляр соответственно.
+static void BM_CompiledGraph(benchmark::State& state) {
+  constexpr int kInstances = 256;
+  static const GraphDescription graph = GraphDescription::load(GRAPH_EXAMPLES_DIR "/quadratic.graph");
+  KernelRegistry registry;
+  registry.add("minus4ac", quadratic_kernels::minus4ac);
+  registry.add("discriminant", quadratic_kernels::discriminant);
+  registry.add("rootPlus", quadratic_kernels::rootPlus);
+  registry.add("rootMinus", quadratic_kernels::rootMinus);
+  registry.add("divide2a", quadratic_kernels::divide2a);
+  registry.add("plus3", quadratic_kernels::plus3);
+
+  for (auto _ : state) {
+    if (state.range(0) == 2) {
+      for (int i = 0; i < kInstances; ++i) benchmark::DoNotOptimize(quadratic(1, -static_cast<float>(i) - 2, 1));
+      continue;
+    }
+    TTaskScheduler sched;
+    for (int i = 0; i < kInstances; ++i) {
+      const float b = -static_cast<float>(i) - 2;
+      if (state.range(0) == 0) {
+        const size_t inputs[] = {sched.add([] { return 1.0f; }), sched.add([b] { return b; }),
+                                 sched.add([] { return 1.0f; })};
+        addGraph(sched, graph, registry, inputs);
+      } else {
+        sched.add(quadratic_task{}, quadratic_task::inputs{1, b, 1});
+      }
+    }
+    sched.executeAll();
+  }
+  state.SetItemsProcessed(state.iterations() * kInstances);
+}
+BENCHMARK(BM_CompiledGraph)->DenseRange(0, 2)->Unit(benchmark::kMicrosecond);
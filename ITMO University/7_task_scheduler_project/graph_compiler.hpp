@@ -0,0 +1,439 @@
+#ifndef GRAPH_COMPILER_HPP
+#define GRAPH_COMPILER_HPP
+
+#include "task_scheduler.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @file graph_compiler.hpp
+ * @brief Описание графа из зарегистрированных ядер и его компиляция заранее
+ * (AOT) в C++ без шедулера.
+ *
+ * Формат описания — текст, строка на объявление, # — комментарий:
+ *
+ *     graph quadratic
+ *     include quadratic_kernels.hpp
+ *     kernel disc : float(float, float) = quadratic_kernels::discriminant
+ *     input a : float
+ *     input b : float
+ *     node d = disc(a, b)
+ *     output d
+ *
+ * kernel задаёт имя ядра, сигнатуру (не больше 2 параметров, как у задач) и
+ * выражение C++, которое вызывается в сгенерированном коде; node — вызов ядра
+ * над входами или другими узлами (в любом порядке объявления); output — узлы
+ * или входы, которые возвращает граф. Одно описание можно:
+ *  - выполнить в TTaskScheduler (addGraph), зарегистрировав ядра в KernelRegistry;
+ *  - скомпилировать compileGraph (утилита graphc) в заголовок с функцией,
+ *    вызывающей ядра в топологическом порядке с результатами в типизированных
+ *    локальных переменных, и функтором <граф>_task — композитной задачей для
+ *    sched.add(). С parallel узлы одного уровня выполняются через std::async.
+ */
+
+/// Разобранное и проверенное описание графа.
+struct GraphDescription {
+  struct Kernel {
+    std::string name;
+    std::string result;
+    std::vector<std::string> params;
+    std::string symbol;  ///< выражение C++, вызываемое в сгенерированном коде
+  };
+
+  struct Input {
+    std::string name;
+    std::string type;
+  };
+
+  struct Node {
+    std::string name;
+    std::string kernel;
+    std::vector<std::string> args;
+    size_t level = 0;  ///< 1 + наибольший уровень аргументов-узлов; у входов 0
+  };
+
+  std::string name;
+  std::vector<std::string> includes;
+  std::vector<Kernel> kernels;
+  std::vector<Input> inputs;
+  std::vector<Node> nodes;  ///< после parse — в топологическом порядке (уровень, порядок объявления)
+  std::vector<std::string> outputs;
+
+  /// Разбирает и проверяет описание; ошибки — std::runtime_error с номером строки.
+  static GraphDescription parse(std::istream& in) {
+    GraphDescription g;
+    std::unordered_map<std::string, size_t> lineOf;
+    std::string line;
+    for (size_t lineNo = 1; std::getline(in, line); ++lineNo) {
+      const std::string text = trim(line.substr(0, line.find('#')));
+      if (text.empty()) continue;
+      auto fail = [lineNo](const std::string& what) {
+        return std::runtime_error("Graph description line " + std::to_string(lineNo) + ": " + what);
+      };
+      const size_t space = text.find_first_of(" \t");
+      const std::string word = text.substr(0, space);
+      const std::string rest = space == std::string::npos ? "" : trim(text.substr(space));
+
+      if (word == "graph") {
+        if (!isIdentifier(rest)) throw fail("bad graph name '" + rest + "'");
+        g.name = rest;
+      } else if (word == "include") {
+        if (rest.empty()) throw fail("empty include");
+        g.includes.push_back(rest);
+      } else if (word == "kernel") {
+        // kernel ИМЯ : R(A, B) = СИМВОЛ
+        const size_t colon = rest.find(':'), eq = rest.find('=', colon);
+        if (colon == std::string::npos || eq == std::string::npos) throw fail("expected 'kernel NAME : R(ARGS) = SYMBOL'");
+        Kernel k;
+        k.name = trim(rest.substr(0, colon));
+        k.symbol = trim(rest.substr(eq + 1));
+        const std::string signature = trim(rest.substr(colon + 1, eq - colon - 1));
+        const size_t open = signature.find('(');
+        if (!isIdentifier(k.name) || k.symbol.empty() || open == std::string::npos || signature.back() != ')') {
+          throw fail("expected 'kernel NAME : R(ARGS) = SYMBOL'");
+        }
+        k.result = trim(signature.substr(0, open));
+        k.params = splitTopLevel(signature.substr(open + 1, signature.size() - open - 2));
+        if (k.result.empty() || k.result == "void") throw fail("kernel '" + k.name + "' must return a value");
+        if (k.params.size() > 2) throw fail("kernel '" + k.name + "' has more than 2 parameters");
+        if (!g.kernelIndex.emplace(k.name, g.kernels.size()).second) throw fail("duplicate kernel '" + k.name + "'");
+        g.kernels.push_back(std::move(k));
+      } else if (word == "input") {
+        const size_t colon = rest.find(':');
+        if (colon == std::string::npos) throw fail("expected 'input NAME : TYPE'");
+        Input v{trim(rest.substr(0, colon)), trim(rest.substr(colon + 1))};
+        if (!isIdentifier(v.name) || v.type.empty()) throw fail("expected 'input NAME : TYPE'");
+        if (!lineOf.emplace(v.name, lineNo).second) throw fail("duplicate value '" + v.name + "'");
+        g.inputs.push_back(std::move(v));
+      } else if (word == "node") {
+        // node ИМЯ = ЯДРО(АРГУМЕНТЫ)
+        const size_t eq = rest.find('='), open = rest.find('(', eq), close = rest.rfind(')');
+        if (eq == std::string::npos || open == std::string::npos || close != rest.size() - 1) {
+          throw fail("expected 'node NAME = KERNEL(ARGS)'");
+        }
+        Node n;
+        n.name = trim(rest.substr(0, eq));
+        n.kernel = trim(rest.substr(eq + 1, open - eq - 1));
+        n.args = splitTopLevel(rest.substr(open + 1, close - open - 1));
+        if (!isIdentifier(n.name) || !isIdentifier(n.kernel)) throw fail("expected 'node NAME = KERNEL(ARGS)'");
+        if (!lineOf.emplace(n.name, lineNo).second) throw fail("duplicate value '" + n.name + "'");
+        g.nodes.push_back(std::move(n));
+      } else if (word == "output") {
+        std::istringstream names(rest);
+        for (std::string o; names >> o;) {
+          g.outputs.push_back(o);
+          lineOf.emplace("output:" + std::to_string(g.outputs.size()), lineNo);
+        }
+      } else {
+        throw fail("unknown declaration '" + word + "'");
+      }
+    }
+    g.check(lineOf);
+    return g;
+  }
+
+  /// parse() файла; std::runtime_error, если файл не открыть.
+  static GraphDescription load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Cannot read graph description " + path);
+    return parse(in);
+  }
+
+  /// Ядро по имени (индекс строится в parse); nullptr, если такого нет.
+  const Kernel* findKernel(const std::string& kernel) const {
+    auto it = kernelIndex.find(kernel);
+    return it == kernelIndex.end() ? nullptr : &kernels[it->second];
+  }
+
+  /// Тип входа или узла по имени (индекс строится в parse); пустая строка, если такого нет.
+  const std::string& typeOf(const std::string& value) const {
+    static const std::string none;
+    auto it = valueTypes.find(value);
+    return it == valueTypes.end() ? none : it->second;
+  }
+
+  static std::string trim(const std::string& s) {
+    const size_t first = s.find_first_not_of(" \t\r");
+    if (first == std::string::npos) return {};
+    return s.substr(first, s.find_last_not_of(" \t\r") - first + 1);
+  }
+
+private:
+  // Поиск по именам за O(1): проверка и генерация обращаются к ним на каждый аргумент.
+  std::unordered_map<std::string, size_t> kernelIndex;
+  std::unordered_map<std::string, std::string> valueTypes;
+
+  static bool isIdentifier(const std::string& s) {
+    if (s.empty() || std::isdigit(static_cast<unsigned char>(s[0]))) return false;
+    return std::all_of(s.begin(), s.end(), [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; });
+  }
+
+  /// Типы сравниваются без учёта пробелов: "std::pair<int,int>" и "std::pair<int, int>" совпадают.
+  static std::string compact(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+      if (!std::isspace(static_cast<unsigned char>(c))) out += c;
+    }
+    return out;
+  }
+
+  /// Делит по запятым вне <>, () и [].
+  static std::vector<std::string> splitTopLevel(const std::string& s) {
+    std::vector<std::string> out;
+    if (trim(s).empty()) return out;
+    int depth = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= s.size(); ++i) {
+      if (i == s.size() || (s[i] == ',' && depth == 0)) {
+        out.push_back(trim(s.substr(start, i - start)));
+        start = i + 1;
+      } else if (s[i] == '<' || s[i] == '(' || s[i] == '[') {
+        ++depth;
+      } else if (s[i] == '>' || s[i] == ')' || s[i] == ']') {
+        --depth;
+      }
+    }
+    return out;
+  }
+
+  // Проверяет ссылки, арность и типы, упорядочивает узлы по уровням.
+  void check(const std::unordered_map<std::string, size_t>& lineOf) {
+    auto fail = [&lineOf](const std::string& value, const std::string& what) {
+      auto it = lineOf.find(value);
+      const std::string where = it == lineOf.end() ? "" : " line " + std::to_string(it->second);
+      return std::runtime_error("Graph description" + where + ": " + what);
+    };
+    if (name.empty()) throw std::runtime_error("Graph description: missing 'graph NAME'");
+    if (outputs.empty()) throw std::runtime_error("Graph description: missing 'output'");
+
+    std::unordered_map<std::string, size_t> nodeIndex;
+    for (size_t i = 0; i < nodes.size(); ++i) nodeIndex.emplace(nodes[i].name, i);
+    for (const Input& v : inputs) valueTypes.emplace(v.name, v.type);
+    for (const Node& n : nodes) {
+      const Kernel* k = findKernel(n.kernel);
+      if (!k) throw fail(n.name, "unknown kernel '" + n.kernel + "'");
+      valueTypes.emplace(n.name, k->result);
+    }
+    for (const Node& n : nodes) {
+      const Kernel* k = findKernel(n.kernel);
+      if (n.args.size() != k->params.size()) {
+        throw fail(n.name, "kernel '" + k->name + "' takes " + std::to_string(k->params.size()) + " arguments");
+      }
+      for (size_t a = 0; a < n.args.size(); ++a) {
+        const std::string& type = typeOf(n.args[a]);
+        if (type.empty()) throw fail(n.name, "unknown value '" + n.args[a] + "'");
+        if (compact(type) != compact(k->params[a])) {
+          throw fail(n.name, "argument '" + n.args[a] + "' is " + type + ", kernel '" + k->name + "' expects " + k->params[a]);
+        }
+      }
+    }
+    for (size_t o = 0; o < outputs.size(); ++o) {
+      if (typeOf(outputs[o]).empty()) throw fail("output:" + std::to_string(o + 1), "unknown output '" + outputs[o] + "'");
+    }
+
+    // Кан по уровням: уровень узла — 1 + наибольший уровень его аргументов-узлов.
+    std::vector<size_t> pending(nodes.size(), 0);
+    std::vector<std::vector<size_t>> consumers(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      for (const std::string& a : nodes[i].args) {
+        auto it = nodeIndex.find(a);
+        if (it == nodeIndex.end()) continue;
+        ++pending[i];
+        consumers[it->second].push_back(i);
+      }
+    }
+    std::vector<size_t> order;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      if (pending[i] == 0) order.push_back(i);
+    }
+    for (size_t head = 0; head < order.size(); ++head) {
+      const size_t v = order[head];
+      for (size_t c : consumers[v]) {
+        nodes[c].level = std::max(nodes[c].level, nodes[v].level + 1);
+        if (--pending[c] == 0) order.push_back(c);
+      }
+    }
+    if (order.size() != nodes.size()) {
+      for (size_t i = 0; i < nodes.size(); ++i) {
+        if (pending[i] != 0) throw fail(nodes[i].name, "cyclic dependency through node '" + nodes[i].name + "'");
+      }
+    }
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return nodes[a].level < nodes[b].level; });
+    std::vector<Node> sorted;
+    sorted.reserve(nodes.size());
+    for (size_t i : order) sorted.push_back(std::move(nodes[i]));
+    nodes.swap(sorted);
+  }
+};
+
+/**
+ * @class KernelRegistry
+ * @brief Ядра по именам для выполнения описания графа в TTaskScheduler без компиляции.
+ */
+class KernelRegistry {
+public:
+  /// Регистрирует функцию; тип ядра берётся из её сигнатуры.
+  template<typename R, typename... A>
+  void add(const std::string& name, R (*f)(A...)) {
+    add<R(A...)>(name, f);
+  }
+
+  /// Регистрирует любой callable с явно заданной сигнатурой: add<float(float, float)>("disc", lambda).
+  template<typename Signature, typename F>
+  void add(const std::string& name, F f) {
+    adders[name] = makeAdder(f, static_cast<Signature*>(nullptr));
+  }
+
+  /// Добавляет задачу ядра name над задачами deps; std::runtime_error для незарегистрированного ядра.
+  size_t addTask(TTaskScheduler& sched, const std::string& name, std::span<const size_t> deps) const {
+    auto it = adders.find(name);
+    if (it == adders.end()) throw std::runtime_error("Kernel '" + name + "' is not registered");
+    return it->second(sched, deps);
+  }
+
+private:
+  using Adder = std::function<size_t(TTaskScheduler&, std::span<const size_t>)>;
+  std::unordered_map<std::string, Adder> adders;
+
+  template<typename F, typename R, typename... A>
+  static Adder makeAdder(F f, R (*)(A...)) {
+    static_assert(sizeof...(A) <= 2, "Максимум 2 аргумента поддерживается");
+    return [f](TTaskScheduler& sched, std::span<const size_t> deps) -> size_t {
+      if (deps.size() != sizeof...(A)) throw std::runtime_error("Kernel arity mismatch");
+      return addWith(sched, f, deps, std::index_sequence_for<A...>{}, static_cast<R (*)(A...)>(nullptr));
+    };
+  }
+
+  template<typename F, size_t... I, typename R, typename... A>
+  static size_t addWith(TTaskScheduler& sched, const F& f, std::span<const size_t> deps, std::index_sequence<I...>,
+                        R (*)(A...)) {
+    return sched.add([f](const std::decay_t<A>&... args) -> R { return f(args...); },
+                     sched.getFutureResult<std::decay_t<A>>(deps[I])...);
+  }
+};
+
+/**
+ * @brief Добавляет граф в sched: входы — уже добавленные задачи inputTasks (в
+ * порядке объявления input), узлы — задачи ядер из registry. Возвращает id
+ * задач-выходов в порядке output.
+ */
+inline std::vector<size_t> addGraph(TTaskScheduler& sched, const GraphDescription& g, const KernelRegistry& registry,
+                                    std::span<const size_t> inputTasks) {
+  if (inputTasks.size() != g.inputs.size()) throw std::invalid_argument("addGraph: wrong number of input tasks");
+  std::unordered_map<std::string, size_t> ids;
+  for (size_t i = 0; i < g.inputs.size(); ++i) ids.emplace(g.inputs[i].name, inputTasks[i]);
+  for (const auto& n : g.nodes) {
+    std::vector<size_t> deps;
+    for (const std::string& a : n.args) deps.push_back(ids.at(a));
+    ids.emplace(n.name, registry.addTask(sched, n.kernel, deps));
+  }
+  std::vector<size_t> out;
+  for (const std::string& o : g.outputs) out.push_back(ids.at(o));
+  return out;
+}
+
+/// Настройки compileGraph.
+struct GraphCompileOptions {
+  std::string name;       ///< имя функции; по умолчанию — имя графа
+  bool parallel = false;  ///< узлы одного уровня (кроме последнего) — через std::async
+};
+
+/**
+ * @brief Генерирует заголовок C++ для графа: функцию NAME(входы) без шедулера,
+ * структуру NAME_outputs при нескольких выходах и функтор NAME_task для
+ * sched.add(NAME_task{}, ...). При больше чем двух входах функтор принимает
+ * вложенную структуру NAME_task::inputs.
+ */
+inline std::string compileGraph(const GraphDescription& g, const GraphCompileOptions& options = {}) {
+  const std::string name = options.name.empty() ? g.name : options.name;
+  std::string guard;
+  for (char c : name) guard += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  guard += "_GRAPH_HPP";
+  const bool multi = g.outputs.size() > 1;
+  const std::string result = multi ? name + "_outputs" : g.typeOf(g.outputs[0]);
+
+  std::ostringstream out;
+  out << "// Сгенерировано graphc из описания графа \"" << g.name << "\"; не редактировать вручную.\n"
+      << "#ifndef " << guard << "\n#define " << guard << "\n\n";
+  for (const std::string& inc : g.includes) out << "#include \"" << inc << "\"\n";
+  if (options.parallel) out << "#include <future>\n";
+  out << "\n";
+
+  if (multi) {
+    out << "struct " << result << " {\n";
+    for (const std::string& o : g.outputs) out << "  " << g.typeOf(o) << " " << o << ";\n";
+    out << "};\n\n";
+  }
+
+  out << "inline " << result << " " << name << "(";
+  for (size_t i = 0; i < g.inputs.size(); ++i) {
+    out << (i ? ", " : "") << "const " << g.inputs[i].type << "& " << g.inputs[i].name;
+  }
+  out << ") {\n";
+
+  auto call = [&g](const GraphDescription::Node& n) {
+    std::string s = g.findKernel(n.kernel)->symbol + "(";
+    for (size_t a = 0; a < n.args.size(); ++a) s += (a ? ", " : "") + n.args[a];
+    return s + ")";
+  };
+  for (size_t first = 0; first < g.nodes.size();) {
+    size_t last = first;
+    while (last < g.nodes.size() && g.nodes[last].level == g.nodes[first].level) ++last;
+    if (options.parallel && last - first > 1) {
+      out << "  // уровень " << g.nodes[first].level << ", параллельно узлов: " << last - first << "\n";
+      for (size_t i = first; i + 1 < last; ++i) {
+        out << "  auto " << g.nodes[i].name << "_async = std::async(std::launch::async, [&] { return "
+            << call(g.nodes[i]) << "; });\n";
+      }
+    }
+    const size_t inlineFrom = options.parallel && last - first > 1 ? last - 1 : first;
+    for (size_t i = inlineFrom; i < last; ++i) {
+      out << "  const " << g.typeOf(g.nodes[i].name) << " " << g.nodes[i].name << " = " << call(g.nodes[i]) << ";\n";
+    }
+    for (size_t i = first; i < inlineFrom; ++i) {
+      out << "  const " << g.typeOf(g.nodes[i].name) << " " << g.nodes[i].name << " = " << g.nodes[i].name
+          << "_async.get();\n";
+    }
+    first = last;
+  }
+  if (multi) {
+    out << "  return {";
+    for (size_t o = 0; o < g.outputs.size(); ++o) out << (o ? ", " : "") << g.outputs[o];
+    out << "};\n";
+  } else {
+    out << "  return " << g.outputs[0] << ";\n";
+  }
+  out << "}\n\n";
+
+  // Композитная задача: задачи шедулера принимают не больше двух аргументов.
+  out << "struct " << name << "_task {\n";
+  if (g.inputs.size() <= 2) {
+    out << "  " << result << " operator()(";
+    for (size_t i = 0; i < g.inputs.size(); ++i) {
+      out << (i ? ", " : "") << "const " << g.inputs[i].type << "& " << g.inputs[i].name;
+    }
+    out << ") const { return " << name << "(";
+    for (size_t i = 0; i < g.inputs.size(); ++i) out << (i ? ", " : "") << g.inputs[i].name;
+    out << "); }\n};\n\n";
+  } else {
+    out << "  struct inputs {\n";
+    for (const auto& v : g.inputs) out << "    " << v.type << " " << v.name << ";\n";
+    out << "  };\n\n  " << result << " operator()(const inputs& in) const { return " << name << "(";
+    for (size_t i = 0; i < g.inputs.size(); ++i) out << (i ? ", " : "") << "in." << g.inputs[i].name;
+    out << "); }\n};\n\n";
+  }
+  out << "#endif // " << guard << "\n";
+  return out.str();
+}
+
+#endif // GRAPH_COMPILER_HPP
@@ -0,0 +1,81 @@
+/**
+ * @file graphc.cpp
+ * @brief Компилятор описания графа в C++ (см. graph_compiler.hpp).
+ *
+ * Читает описание графа из зарегистрированных ядер и пишет заголовок с
+ * функцией, которая вызывает ядра в топологическом порядке без шедулера, и
+ * функтором <имя>_task для добавления всего графа одной задачей TTaskScheduler.
+ *
+ * Параметры:
+ *  - --out=PATH — куда писать (по умолчанию stdout);
+ *  - --name=NAME — имя функции вместо имени графа;
+ *  - --parallel — узлы одного уровня выполняются через std::async.
+ *
+ * Пример: `./graphc quadratic.graph --out=quadratic_graph.hpp --parallel`.
+ * Код возврата 1 при ошибке в описании, 2 при неверных параметрах.
+ */
+
+#include "graph_compiler.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace {
+
+struct Options {
+  std::string input;
+  std::string out;
+  GraphCompileOptions compile;
+};
+
+bool parse(int argc, char** argv, Options& opt) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.substr(0, 2) != "--") {
+      if (!opt.input.empty()) return false;
+      opt.input = arg;
+      continue;
+    }
+    const size_t eq = arg.find('=');
+    const std::string key(arg.substr(2, eq == std::string_view::npos ? arg.npos : eq - 2));
+    const std::string value = eq == std::string_view::npos ? "" : std::string(arg.substr(eq + 1));
+    if (key == "out" && !value.empty()) opt.out = value;
+    else if (key == "name" && !value.empty()) opt.compile.name = value;
+    else if (key == "parallel" && eq == std::string_view::npos) opt.compile.parallel = true;
+    else return false;
+  }
+  return !opt.input.empty();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  if (!parse(argc, argv, opt)) {
+    std::fprintf(stderr, "usage: %s GRAPH [--out=PATH] [--name=NAME] [--parallel]\n", argv[0]);
+    return 2;
+  }
+
+  std::string code;
+  try {
+    code = compileGraph(GraphDescription::load(opt.input), opt.compile);
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "%s: %s\n", opt.input.c_str(), e.what());
+    return 1;
+  }
+
+  if (opt.out.empty()) {
+    std::cout << code;
+    return 0;
+  }
+  std::ofstream out(opt.out);
+  if (!(out << code)) {
+    std::fprintf(stderr, "cannot write %s\n", opt.out.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,246 @@
+/**
+ * @file loadgen.cpp
+ * @brief Генератор нагрузки с открытым циклом: задержка getResult под потоком запросов.
+ *
+ * N клиентских потоков посылают запросы по заранее заданному расписанию
+ * (пуассоновский поток с суммарной частотой --rate), не дожидаясь ответа на
+ * предыдущий, чтобы назначить следующий. Задержка считается от запланированного
+ * момента запроса, а не от фактического: если шедулер не успевает, очередь
+ * растёт и это видно в хвосте распределения (без coordinated omission).
+ *
+ * Виды запросов (--graph):
+ *  - shared — все клиенты работают с одним шедулером на пуле: запрос добавляет
+ *    короткую цепочку поверх двух случайных узлов общего случайного DAG и ждёт
+ *    getResult её конца. Конусы запросов пересекаются, первые запросы вычисляют
+ *    общие узлы, остальные берут их готовыми;
+ *  - private — каждый запрос строит и вычисляет свой небольшой граф в отдельном шедулере;
+ *  - mixed — половина запросов того и другого вида.
+ *
+ * С --sweep частота растёт в --step раз за шаг, пока задержка не «сломается»:
+ * достигнутая частота ниже 95% заданной или p99 больше --collapse × p99 первого шага.
+ *
+ * Пример: `./loadgen --clients=8 --threads=4 --graph=shared --sweep=500 --duration=2`.
+ */
+
+#include "task_scheduler.hpp"
+#include "random_dag.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  size_t clients = 4;
+  size_t threads = std::max(2u, std::thread::hardware_concurrency());
+  std::string graph = "shared";
+  size_t baseNodes = 20000;  ///< узлы общего графа
+  size_t querySize = 8;      ///< задачи, которые добавляет один запрос
+  uint32_t cost = 200;       ///< раунды перемешивания на задачу запроса
+  std::vector<double> rates{1000};
+  double sweepFrom = 0;
+  double step = 1.5;
+  size_t maxSteps = 20;
+  double duration = 1;       ///< секунды на шаг
+  double collapse = 10;
+  uint64_t seed = 1;
+};
+
+/// Задача запроса: cost раундов перемешивания над входом.
+struct Spin {
+  uint32_t rounds;
+  uint64_t operator()(uint64_t x) const {
+    for (uint32_t k = 0; k < rounds; ++k) x = RandomDag::mix(x);
+    return x;
+  }
+};
+
+struct Combine {
+  uint64_t operator()(uint64_t a, uint64_t b) const { return RandomDag::mix(a ^ (b << 1)); }
+};
+
+/// Общий граф шага: шедулер на пуле и ещё не вычисленный случайный DAG в нём.
+struct SharedGraph {
+  RandomDag base;
+  TTaskScheduler sched;
+
+  SharedGraph(const Options& opt, uint64_t seed) : base(config(opt, seed)), sched(opt.threads) { base.addTo(sched); }
+
+  static RandomDagConfig config(const Options& opt, uint64_t seed) {
+    RandomDagConfig c;
+    c.nodes = opt.baseNodes;
+    c.depth = 64;
+    c.cost = opt.cost;
+    c.seed = seed;
+    return c;
+  }
+};
+
+struct StepResult {
+  double offered = 0;
+  double achieved = 0;
+  LatencyHistogram latency;
+};
+
+uint64_t splitmix(uint64_t& state) { return RandomDag::mix(state += 0x9e3779b97f4a7c15ULL); }
+
+double unit(uint64_t& state) { return static_cast<double>(splitmix(state) >> 11) * 0x1.0p-53; }
+
+void sharedRequest(SharedGraph& g, const Options& opt, uint64_t& rng) {
+  TTaskScheduler& s = g.sched;
+  const size_t a = splitmix(rng) % g.base.size(), b = splitmix(rng) % g.base.size();
+  size_t prev = s.add(Combine{}, s.getFutureResult<uint64_t>(a), s.getFutureResult<uint64_t>(b));
+  for (size_t i = 1; i < opt.querySize; ++i) prev = s.add(Spin{opt.cost}, s.getFutureResult<uint64_t>(prev));
+  s.getResult<uint64_t>(prev);
+}
+
+void privateRequest(const Options& opt, uint64_t& rng) {
+  RandomDagConfig c;
+  c.nodes = opt.querySize * 8;
+  c.depth = opt.querySize;
+  c.cost = opt.cost;
+  c.seed = splitmix(rng);
+  const RandomDag dag(c);
+  TTaskScheduler s;
+  dag.addTo(s);
+  s.getResult<uint64_t>(dag.size() - 1);
+}
+
+StepResult runStep(double rate, const Options& opt, uint64_t stepSeed) {
+  const bool needsShared = opt.graph != "private";
+  std::unique_ptr<SharedGraph> shared;
+  if (needsShared) shared = std::make_unique<SharedGraph>(opt, stepSeed);
+
+  std::vector<LatencyHistogram> latencies(opt.clients);
+  std::atomic<uint64_t> completed{0};
+  const auto start = Clock::now() + std::chrono::milliseconds(20);
+  const auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opt.duration));
+  const double meanGapNs = 1e9 * static_cast<double>(opt.clients) / rate;
+
+  std::vector<std::thread> clients;
+  for (size_t c = 0; c < opt.clients; ++c) {
+    clients.emplace_back([&, c] {
+      uint64_t rng = stepSeed * 1000003 + c;
+      auto due = start;
+      for (uint64_t n = 0;; ++n) {
+        // Пуассоновский поток: экспоненциальные промежутки между запросами клиента.
+        due += std::chrono::nanoseconds(static_cast<int64_t>(-std::log1p(-unit(rng)) * meanGapNs));
+        if (due >= end) break;
+        std::this_thread::sleep_until(due);
+        const bool useShared = opt.graph == "shared" || (opt.graph == "mixed" && n % 2 == 0);
+        if (useShared) {
+          sharedRequest(*shared, opt, rng);
+        } else {
+          privateRequest(opt, rng);
+        }
+        latencies[c].record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - due).count()));
+        completed.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+  for (auto& t : clients) t.join();
+
+  // Запросы, запланированные до end, но завершённые позже, растягивают шаг.
+  const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  StepResult r;
+  r.offered = rate;
+  r.achieved = static_cast<double>(completed.load()) / std::max(elapsed, opt.duration);
+  for (const auto& h : latencies) r.latency.merge(h);
+  return r;
+}
+
+std::vector<double> parseList(const char* text) {
+  std::vector<double> out;
+  for (char* p = const_cast<char*>(text); *p;) {
+    out.push_back(std::strtod(p, &p));
+    if (*p == ',') ++p;
+    else if (*p) return {};
+  }
+  return out;
+}
+
+bool parse(int argc, char** argv, Options& opt) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const size_t eq = arg.find('=');
+    if (arg.substr(0, 2) != "--" || eq == std::string_view::npos) return false;
+    const std::string key(arg.substr(2, eq - 2));
+    const char* value = argv[i] + eq + 1;
+    if (key == "clients") opt.clients = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+    else if (key == "threads") opt.threads = std::strtoull(value, nullptr, 10);
+    else if (key == "graph") opt.graph = value;
+    else if (key == "base") opt.baseNodes = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+    else if (key == "query") opt.querySize = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+    else if (key == "cost") opt.cost = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+    else if (key == "rate") opt.rates = parseList(value);
+    else if (key == "sweep") opt.sweepFrom = std::strtod(value, nullptr);
+    else if (key == "step") opt.step = std::strtod(value, nullptr);
+    else if (key == "steps") opt.maxSteps = std::strtoull(value, nullptr, 10);
+    else if (key == "duration") opt.duration = std::strtod(value, nullptr);
+    else if (key == "collapse") opt.collapse = std::strtod(value, nullptr);
+    else if (key == "seed") opt.seed = std::strtoull(value, nullptr, 10);
+    else return false;
+  }
+  const bool graphOk = opt.graph == "shared" || opt.graph == "private" || opt.graph == "mixed";
+  // Общий граф вычисляется из нескольких потоков сразу — это допустимо только с пулом.
+  const bool poolOk = opt.graph == "private" || opt.threads > 0;
+  return graphOk && poolOk && !opt.rates.empty() && opt.step > 1 && opt.duration > 0;
+}
+
+double micros(uint64_t ns) { return static_cast<double>(ns) * 1e-3; }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  if (!parse(argc, argv, opt)) {
+    std::fprintf(stderr,
+                 "usage: %s [--clients=N] [--threads=T>0] [--graph=shared|private|mixed] [--base=NODES]\n"
+                 "          [--query=TASKS] [--cost=ROUNDS] [--rate=R1,R2,...] [--sweep=R0 [--step=X] [--steps=K]]\n"
+                 "          [--duration=SECONDS] [--collapse=FACTOR] [--seed=S]\n",
+                 argv[0]);
+    return 2;
+  }
+
+  std::printf("%zu clients, %zu pool threads, %s graphs, %zu tasks per request, %u rounds per task\n",
+              opt.clients, opt.threads, opt.graph.c_str(), opt.querySize, opt.cost);
+  std::printf("%10s %10s %10s %10s %10s %10s %10s\n", "offered/s", "achieved/s", "p50, us", "p90, us", "p99, us",
+              "p999, us", "max, us");
+
+  const bool sweep = opt.sweepFrom > 0;
+  const size_t steps = sweep ? opt.maxSteps : opt.rates.size();
+  double baselineP99 = 0, lastGood = 0;
+  for (size_t i = 0; i < steps; ++i) {
+    const double rate = sweep ? opt.sweepFrom * std::pow(opt.step, static_cast<double>(i)) : opt.rates[i];
+    const StepResult r = runStep(rate, opt, opt.seed + i);
+    const auto s = r.latency.summary();
+    const uint64_t p90 = r.latency.quantile(0.9);
+    std::printf("%10.0f %10.0f %10.1f %10.1f %10.1f %10.1f %10.1f\n", r.offered, r.achieved, micros(s.p50),
+                micros(p90), micros(s.p99), micros(s.p999), micros(s.max));
+    std::fflush(stdout);
+    if (!sweep) continue;
+
+    if (i == 0) baselineP99 = static_cast<double>(s.p99);
+    const bool saturated = r.achieved < 0.95 * r.offered;
+    const bool tail = static_cast<double>(s.p99) > opt.collapse * baselineP99;
+    if (saturated || tail) {
+      std::printf("collapse at %.0f req/s (%s); last sustainable rate %.0f req/s\n", rate,
+                  saturated ? "throughput below 95% of offered" : "p99 above collapse threshold", lastGood);
+      return 0;
+    }
+    lastGood = rate;
+  }
+  if (sweep) std::printf("no collapse up to %.0f req/s\n", lastGood);
+  return 0;
+}
@@ -0,0 +1,364 @@
+#ifndef METRICS_SERVER_HPP
+#define METRICS_SERVER_HPP
+
+#include "task_scheduler.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * @file metrics_server.hpp
+ * @brief Необязательная HTTP-точка на localhost для наблюдения за работающим
+ * TTaskScheduler: снимок TTaskScheduler::metrics() в формате Prometheus и JSON.
+ *
+ * Отдельный заголовок, чтобы основной не тянул за собой сокеты POSIX.
+ */
+
+/// Строка в кавычках для метки Prometheus: экранирует \, " и перевод строки.
+inline void appendPrometheusLabel(std::string& out, std::string_view v) {
+  out += '"';
+  for (char c : v) {
+    if (c == '\\' || c == '"') out += '\\';
+    if (c == '\n') {
+      out += "\\n";
+      continue;
+    }
+    out += c;
+  }
+  out += '"';
+}
+
+/// Строка JSON в кавычках.
+inline void appendJsonString(std::string& out, std::string_view v) {
+  out += '"';
+  for (char c : v) {
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+          out += buf;
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+/**
+ * @brief Снимок метрик в текстовом формате Prometheus (version 0.0.4).
+ * Задержки — summary в секундах по видам задач, память — gauge в байтах.
+ */
+inline std::string formatPrometheus(const TTaskScheduler::Metrics& m) {
+  std::string out;
+  auto type = [&](const char* name, const char* kind) {
+    out += "# TYPE task_scheduler_";
+    out += name;
+    out += ' ';
+    out += kind;
+    out += '\n';
+  };
+  auto value = [&](const char* name, uint64_t v) {
+    out += "task_scheduler_";
+    out += name;
+    out += ' ';
+    out += std::to_string(v);
+    out += '\n';
+  };
+  auto scalar = [&](const char* name, const char* kind, uint64_t v) {
+    type(name, kind);
+    value(name, v);
+  };
+  auto labeled = [&](const char* name, const char* label, std::string_view labelValue, const char* extra,
+                     const std::string& v) {
+    out += "task_scheduler_";
+    out += name;
+    out += '{';
+    out += label;
+    out += '=';
+    appendPrometheusLabel(out, labelValue);
+    out += extra;
+    out += "} ";
+    out += v;
+    out += '\n';
+  };
+  auto seconds = [](uint64_t ns) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", static_cast<double>(ns) * 1e-9);
+    return std::string(buf);
+  };
+
+  scalar("executions_total", "counter", m.stats.executions);
+  scalar("recomputes_total", "counter", m.stats.recomputes);
+  scalar("dropped_total", "counter", m.stats.dropped);
+  scalar("speculated_total", "counter", m.stats.speculated);
+  scalar("allocations_total", "counter", m.stats.allocations);
+  scalar("allocated_bytes_total", "counter", m.stats.allocatedBytes);
+  scalar("resident_bytes", "gauge", m.stats.residentBytes);
+  scalar("tasks", "gauge", m.tasks);
+  scalar("queue_depth", "gauge", m.queued);
+  scalar("inflight_tasks", "gauge", m.inflight);
+  scalar("evaluating", "gauge", m.evaluating ? 1 : 0);
+  scalar("snapshot_version", "gauge", m.version);
+
+  const std::pair<const char*, const LatencyHistogram TTaskScheduler::KindLatency::*> histograms[] = {
+      {"execution_seconds", &TTaskScheduler::KindLatency::execution},
+      {"queue_wait_seconds", &TTaskScheduler::KindLatency::queueWait},
+      {"request_seconds", &TTaskScheduler::KindLatency::request},
+  };
+  for (const auto& [name, member] : histograms) {
+    type(name, "summary");
+    for (const auto& k : m.kinds) {
+      const LatencyHistogram& h = k.latency.*member;
+      if (h.count() == 0) continue;
+      const auto s = h.summary();
+      labeled(name, "kind", k.name, ",quantile=\"0.5\"", seconds(s.p50));
+      labeled(name, "kind", k.name, ",quantile=\"0.99\"", seconds(s.p99));
+      labeled(name, "kind", k.name, ",quantile=\"0.999\"", seconds(s.p999));
+      const std::string base = name;
+      labeled((base + "_sum").c_str(), "kind", k.name, "", seconds(h.sum()));
+      labeled((base + "_count").c_str(), "kind", k.name, "", std::to_string(s.count));
+    }
+  }
+
+  type("kind_allocations_total", "counter");
+  for (const auto& k : m.kinds) {
+    if (k.allocations.allocations) {
+      labeled("kind_allocations_total", "kind", k.name, "", std::to_string(k.allocations.allocations));
+    }
+  }
+  type("kind_allocated_bytes_total", "counter");
+  for (const auto& k : m.kinds) {
+    if (k.allocations.allocations) {
+      labeled("kind_allocated_bytes_total", "kind", k.name, "", std::to_string(k.allocations.bytes));
+    }
+  }
+
+  type("footprint_kind_bytes", "gauge");
+  for (const auto& e : m.footprint.byKind) labeled("footprint_kind_bytes", "kind", e.name, "", std::to_string(e.bytes));
+  type("footprint_type_bytes", "gauge");
+  for (const auto& e : m.footprint.byType) labeled("footprint_type_bytes", "type", e.name, "", std::to_string(e.bytes));
+  return out;
+}
+
+/// Снимок метрик в JSON; задержки — в наносекундах.
+inline std::string formatJson(const TTaskScheduler::Metrics& m) {
+  std::string out = "{";
+  auto field = [&](const char* name, uint64_t v, bool comma = true) {
+    out += '"';
+    out += name;
+    out += "\":";
+    out += std::to_string(v);
+    if (comma) out += ',';
+  };
+  auto histogram = [&](const char* name, const LatencyHistogram& h) {
+    const auto s = h.summary();
+    out += '"';
+    out += name;
+    out += "\":{";
+    field("count", s.count);
+    field("sumNs", h.sum());
+    field("p50Ns", s.p50);
+    field("p99Ns", s.p99);
+    field("p999Ns", s.p999);
+    field("maxNs", s.max, false);
+    out += '}';
+  };
+  auto entries = [&](const char* name, const std::vector<TTaskScheduler::FootprintEntry>& list) {
+    out += '"';
+    out += name;
+    out += "\":[";
+    for (size_t i = 0; i < list.size(); ++i) {
+      out += i ? ",{\"name\":" : "{\"name\":";
+      appendJsonString(out, list[i].name);
+      out += ',';
+      field("bytes", list[i].bytes);
+      field("count", list[i].count, false);
+      out += '}';
+    }
+    out += ']';
+  };
+
+  field("version", m.version);
+  out += "\"evaluating\":";
+  out += m.evaluating ? "true," : "false,";
+  field("tasks", m.tasks);
+  field("queued", m.queued);
+  field("inflight", m.inflight);
+
+  out += "\"stats\":{";
+  field("executions", m.stats.executions);
+  field("recomputes", m.stats.recomputes);
+  field("dropped", m.stats.dropped);
+  field("residentBytes", m.stats.residentBytes);
+  field("speculated", m.stats.speculated);
+  field("allocations", m.stats.allocations);
+  field("allocatedBytes", m.stats.allocatedBytes, false);
+  out += "},\"kinds\":[";
+  for (size_t i = 0; i < m.kinds.size(); ++i) {
+    const auto& k = m.kinds[i];
+    out += i ? ",{\"name\":" : "{\"name\":";
+    appendJsonString(out, k.name);
+    out += ',';
+    histogram("execution", k.latency.execution);
+    out += ',';
+    histogram("queueWait", k.latency.queueWait);
+    out += ',';
+    histogram("request", k.latency.request);
+    out += ',';
+    field("allocations", k.allocations.allocations);
+    field("allocatedBytes", k.allocations.bytes, false);
+    out += '}';
+  }
+
+  out += "],\"footprint\":{";
+  field("totalBytes", m.footprint.totalBytes);
+  out += "\"tasks\":[";
+  for (size_t i = 0; i < m.footprint.tasks.size(); ++i) {
+    out += i ? ",{" : "{";
+    field("id", m.footprint.tasks[i].first);
+    field("bytes", m.footprint.tasks[i].second, false);
+    out += '}';
+  }
+  out += "],";
+  entries("byKind", m.footprint.byKind);
+  out += ',';
+  entries("byType", m.footprint.byType);
+  out += "}}";
+  return out;
+}
+
+/**
+ * @class MetricsServer
+ * @brief HTTP-сервер на 127.0.0.1 с метриками одного шедулера.
+ *
+ * GET /metrics — формат Prometheus, GET /metrics.json — JSON. Запросы
+ * обслуживает один фоновый поток по одному соединению за раз; каждый ответ —
+ * свежий TTaskScheduler::metrics(), поэтому вычисление графа наблюдение почти
+ * не замедляет. Конструктор включает enableMetrics() у шедулера — создавать
+ * сервер, пока граф не вычисляется. Шедулер должен пережить сервер.
+ */
+class MetricsServer {
+public:
+  /// @param port 0 — свободный порт, выбранный системой (см. port()).
+  explicit MetricsServer(TTaskScheduler& sched, uint16_t port = 0) : sched(sched) {
+    listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) throw std::system_error(errno, std::generic_category(), "MetricsServer: socket");
+    const int one = 1;
+    ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    socklen_t len = sizeof(addr);
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listenFd, 16) != 0 ||
+        ::getsockname(listenFd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+      const int err = errno;
+      ::close(listenFd);
+      throw std::system_error(err, std::generic_category(), "MetricsServer: bind");
+    }
+    boundPort = ntohs(addr.sin_port);
+
+    sched.enableMetrics();
+    worker = std::thread([this] { serve(); });
+  }
+
+  ~MetricsServer() {
+    stopping.store(true, std::memory_order_relaxed);
+    worker.join();
+    ::close(listenFd);
+  }
+
+  MetricsServer(const MetricsServer&) = delete;
+  MetricsServer& operator=(const MetricsServer&) = delete;
+
+  uint16_t port() const { return boundPort; }
+
+private:
+  /// Как часто фоновый поток проверяет остановку.
+  static constexpr int kPollMs = 50;
+
+  TTaskScheduler& sched;
+  int listenFd = -1;
+  uint16_t boundPort = 0;
+  std::atomic<bool> stopping{false};
+  std::thread worker;
+
+  void serve() {
+    pollfd p{listenFd, POLLIN, 0};
+    while (!stopping.load(std::memory_order_relaxed)) {
+      if (::poll(&p, 1, kPollMs) <= 0) continue;
+      const int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd < 0) continue;
+      // Медленный клиент не должен держать поток дольше секунды.
+      timeval timeout{1, 0};
+      ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      handle(fd);
+      ::close(fd);
+    }
+  }
+
+  void handle(int fd) {
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+      const ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) return;
+      request.append(buf, static_cast<size_t>(n));
+    }
+
+    const size_t lineEnd = request.find("\r\n");
+    const std::string_view line = std::string_view(request).substr(0, lineEnd);
+    const size_t sp1 = line.find(' ');
+    const size_t sp2 = line.find(' ', sp1 + 1);
+    const std::string_view method = line.substr(0, sp1);
+    const std::string_view path =
+        sp1 == std::string_view::npos ? std::string_view() : line.substr(sp1 + 1, sp2 - sp1 - 1);
+
+    if (method != "GET") {
+      respond(fd, "405 Method Not Allowed", "text/plain", "only GET is supported\n");
+    } else if (path == "/metrics") {
+      respond(fd, "200 OK", "text/plain; version=0.0.4", formatPrometheus(*sched.metrics()));
+    } else if (path == "/metrics.json") {
+      respond(fd, "200 OK", "application/json", formatJson(*sched.metrics()));
+    } else {
+      respond(fd, "404 Not Found", "text/plain", "try /metrics or /metrics.json\n");
+    }
+  }
+
+  static void respond(int fd, const char* status, const char* contentType, const std::string& body) {
+    std::string out = "HTTP/1.1 ";
+    out += status;
+    out += "\r\nContent-Type: ";
+    out += contentType;
+    out += "\r\nContent-Length: ";
+    out += std::to_string(body.size());
+    out += "\r\nConnection: close\r\n\r\n";
+    out += body;
+    for (size_t sent = 0; sent < out.size();) {
+      const ssize_t n = ::send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0) return;
+      sent += static_cast<size_t>(n);
+    }
+  }
+};
+
+#endif // METRICS_SERVER_HPP
@@ -0,0 +1,410 @@
+#ifndef PARALLEL_ALGORITHMS_HPP
+#define PARALLEL_ALGORITHMS_HPP
+
+#include "task_scheduler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @file parallel_algorithms.hpp
+ * @brief Готовые узлы-алгоритмы над непрерывными буферами: префиксная сумма,
+ * сортировка слиянием и поразрядная, гистограмма и устойчивое разбиение.
+ *
+ * Каждый узел — callable над const std::vector<T>&, который добавляется в граф
+ * одной задачей: sched.add(ParallelSort<int>{}, sched.getFutureResult<std::vector<int>>(src)).
+ * Внутри узел делит буфер на куски (не меньше grain элементов, не больше
+ * 4 кусков на поток) и выполняет их на пуле, в потоке которого запущен, —
+ * отдельных задач на элементы нет. Вне пула (последовательный шедулер, прямой
+ * вызов) узел работает одним куском. Результат и временные буферы берутся из
+ * buffers (например, sched.buffers()), если он задан.
+ */
+
+/// Минимальный кусок узла по умолчанию, элементов.
+inline constexpr size_t kParallelGrain = size_t(1) << 14;
+
+/// Число кусков для n элементов на пуле вызывающего потока.
+inline size_t parallelChunks(size_t n, size_t grain) {
+  const ThreadPool* pool = ThreadPool::current();
+  if (!pool || n == 0) return 1;
+  const size_t byGrain = (n + std::max<size_t>(grain, 1) - 1) / std::max<size_t>(grain, 1);
+  return std::max<size_t>(1, std::min(byGrain, 4 * pool->size()));
+}
+
+/// Граница куска c из chunks для n элементов: [chunkBegin(c), chunkBegin(c + 1)).
+inline size_t chunkBegin(size_t c, size_t chunks, size_t n) { return n / chunks * c + std::min(c, n % chunks); }
+
+/**
+ * @brief Выполняет fn(c) для всех c из [0, chunks) и возвращается, когда все
+ * выполнены; первое исключение пробрасывается.
+ *
+ * На потоке пула куски разбирают вызывающий поток и до size() - 1 заданий
+ * пула; ожидая чужие куски, поток выполняет другие задания (runPending), так
+ * что вложенные узлы не занимают пул намертво.
+ */
+template<typename Fn>
+void forEachChunk(size_t chunks, Fn&& fn) {
+  ThreadPool* pool = ThreadPool::current();
+  if (!pool || pool->size() < 2 || chunks < 2) {
+    for (size_t c = 0; c < chunks; ++c) fn(c);
+    return;
+  }
+
+  // Задание пула может стартовать уже после возврата: оно владеет State, а fn
+  // трогает только захватив кусок — тогда вызывающий ещё ждёт его завершения.
+  struct State {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    size_t chunks = 0;
+    void* fn = nullptr;
+    void (*call)(void*, size_t) = nullptr;
+    std::mutex m;
+    std::exception_ptr error;
+
+    void drain() {
+      for (size_t c; (c = next.fetch_add(1, std::memory_order_relaxed)) < chunks;) {
+        try {
+          call(fn, c);
+        } catch (...) {
+          std::lock_guard<std::mutex> lk(m);
+          if (!error) error = std::current_exception();
+        }
+        done.fetch_add(1, std::memory_order_acq_rel);
+      }
+    }
+  };
+  auto state = std::make_shared<State>();
+  state->chunks = chunks;
+  state->fn = &fn;
+  state->call = [](void* f, size_t c) { (*static_cast<std::remove_reference_t<Fn>*>(f))(c); };
+
+  const size_t helpers = std::min(chunks - 1, pool->size() - 1);
+  for (size_t h = 0; h < helpers; ++h) pool->submit([state] { state->drain(); });
+  state->drain();
+  while (state->done.load(std::memory_order_acquire) < chunks) {
+    if (!pool->runPending()) std::this_thread::yield();
+  }
+  if (state->error) std::rethrow_exception(state->error);
+}
+
+namespace parallel_detail {
+
+template<typename T>
+std::vector<T> acquire(const BufferHandle& buffers, size_t n) {
+  return buffers.template acquire<T>(n);
+}
+
+template<typename T>
+void release(const BufferHandle& buffers, std::vector<T>&& v) {
+  if (buffers.get()) buffers.get()->release(std::move(v));
+}
+
+}  // namespace parallel_detail
+
+/**
+ * @struct ParallelScan
+ * @brief Префиксная «сумма» по ассоциативной op: inclusive — out[i] = init op in[0] op ... op in[i],
+ * exclusive — то же до in[i - 1] (out[0] = init), как std::inclusive_scan/exclusive_scan с init.
+ *
+ * Три прохода: итоги кусков, их последовательный скан, скан кусков со смещением.
+ */
+template<typename T, typename Op = std::plus<T>>
+struct ParallelScan {
+  Op op{};
+  T init{};
+  bool exclusive = false;
+  size_t grain = kParallelGrain;
+  BufferHandle buffers{};
+
+  std::vector<T> operator()(const std::vector<T>& in) const {
+    const size_t n = in.size();
+    std::vector<T> out = parallel_detail::acquire<T>(buffers, n);
+    if (n == 0) return out;
+    const size_t chunks = parallelChunks(n, grain);
+
+    std::vector<T> offsets(chunks, init);
+    if (chunks > 1) {
+      std::vector<T> totals(chunks);
+      forEachChunk(chunks, [&](size_t c) {
+        const size_t first = chunkBegin(c, chunks, n), last = chunkBegin(c + 1, chunks, n);
+        T acc = in[first];
+        for (size_t i = first + 1; i < last; ++i) acc = op(acc, in[i]);
+        totals[c] = acc;
+      });
+      for (size_t c = 1; c < chunks; ++c) offsets[c] = op(offsets[c - 1], totals[c - 1]);
+    }
+
+    forEachChunk(chunks, [&](size_t c) {
+      const size_t first = chunkBegin(c, chunks, n), last = chunkBegin(c + 1, chunks, n);
+      T acc = offsets[c];
+      for (size_t i = first; i < last; ++i) {
+        if (exclusive) {
+          out[i] = acc;
+          acc = op(acc, in[i]);
+        } else {
+          acc = op(acc, in[i]);
+          out[i] = acc;
+        }
+      }
+    });
+    return out;
+  }
+};
+
+/**
+ * @struct ParallelSort
+ * @brief Устойчивая сортировка слиянием: куски сортируются std::stable_sort,
+ * затем раунды попарных слияний. Каждое слияние делится по выходу на куски
+ * поиском точки раздела (merge path), поэтому и последние раунды параллельны.
+ */
+template<typename T, typename Compare = std::less<T>>
+struct ParallelSort {
+  Compare comp{};
+  size_t grain = kParallelGrain;
+  BufferHandle buffers{};
+
+  std::vector<T> operator()(const std::vector<T>& in) const {
+    const size_t n = in.size();
+    std::vector<T> out = parallel_detail::acquire<T>(buffers, n);
+    std::copy(in.begin(), in.end(), out.begin());
+    const size_t chunks = parallelChunks(n, grain);
+    if (chunks < 2) {
+      std::stable_sort(out.begin(), out.end(), comp);
+      return out;
+    }
+
+    std::vector<size_t> runs(chunks + 1);
+    for (size_t c = 0; c <= chunks; ++c) runs[c] = chunkBegin(c, chunks, n);
+    forEachChunk(chunks, [&](size_t c) { std::stable_sort(out.begin() + runs[c], out.begin() + runs[c + 1], comp); });
+
+    std::vector<T> tmp = parallel_detail::acquire<T>(buffers, n);
+    std::vector<T>* src = &out;
+    std::vector<T>* dst = &tmp;
+    const size_t piece = (n + chunks - 1) / chunks;
+    struct Piece {
+      size_t left, mid, right;  ///< сливаются [left, mid) и [mid, right)
+      size_t from, to;          ///< отрезок выхода этого куска, от left
+    };
+    std::vector<Piece> pieces;
+    while (runs.size() > 2) {
+      pieces.clear();
+      std::vector<size_t> merged;
+      for (size_t r = 0; r + 1 < runs.size(); r += 2) {
+        merged.push_back(runs[r]);
+        const size_t left = runs[r], mid = runs[r + 1], right = r + 2 < runs.size() ? runs[r + 2] : mid;
+        for (size_t from = 0; from < right - left; from += piece) {
+          pieces.push_back({left, mid, right, from, std::min(from + piece, right - left)});
+        }
+      }
+      merged.push_back(n);
+
+      const T* s = src->data();
+      T* d = dst->data();
+      forEachChunk(pieces.size(), [&](size_t p) {
+        const Piece& pc = pieces[p];
+        const T* a = s + pc.left;
+        const T* b = s + pc.mid;
+        const size_t m = pc.mid - pc.left, k = pc.right - pc.mid;
+        const size_t i0 = coRank(pc.from, a, m, b, k), i1 = coRank(pc.to, a, m, b, k);
+        std::merge(a + i0, a + i1, b + (pc.from - i0), b + (pc.to - i1), d + pc.left + pc.from, comp);
+      });
+      std::swap(src, dst);
+      runs.swap(merged);
+    }
+    if (src != &out) out.swap(tmp);
+    parallel_detail::release(buffers, std::move(tmp));
+    return out;
+  }
+
+private:
+  /// Сколько из первых k элементов устойчивого слияния a[0, m) и b[0, k) взято из a.
+  size_t coRank(size_t k, const T* a, size_t m, const T* b, size_t nb) const {
+    size_t lo = k > nb ? k - nb : 0, hi = std::min(k, m);
+    for (;;) {
+      const size_t i = lo + (hi - lo) / 2, j = k - i;
+      if (i > 0 && j < nb && comp(b[j], a[i - 1])) {
+        hi = i - 1;  // a[i - 1] должен идти после b[j]
+      } else if (j > 0 && i < m && !comp(b[j - 1], a[i])) {
+        lo = i + 1;  // при равенстве a идёт раньше b
+      } else {
+        return i;
+      }
+    }
+  }
+};
+
+/**
+ * @struct ParallelRadixSort
+ * @brief Устойчивая поразрядная сортировка целых по байтам (LSD).
+ *
+ * На каждый разряд: гистограммы кусков, смещения (разряд, затем кусок) и
+ * раскладка кусков по своим смещениям. Разряд, в котором все ключи совпадают,
+ * пропускается. Знаковые ключи сортируются по значению (старший бит инвертируется).
+ */
+template<typename T>
+struct ParallelRadixSort {
+  static_assert(std::is_integral_v<T>, "ParallelRadixSort сортирует целые");
+
+  size_t grain = kParallelGrain;
+  BufferHandle buffers{};
+
+  std::vector<T> operator()(const std::vector<T>& in) const {
+    using U = std::make_unsigned_t<T>;
+    constexpr size_t kRadix = 256;
+    const size_t n = in.size();
+    std::vector<T> out = parallel_detail::acquire<T>(buffers, n);
+    std::copy(in.begin(), in.end(), out.begin());
+    if (n < 2) return out;
+
+    const size_t chunks = parallelChunks(n, grain);
+    std::vector<T> tmp = parallel_detail::acquire<T>(buffers, n);
+    std::vector<T>* src = &out;
+    std::vector<T>* dst = &tmp;
+    std::vector<std::array<size_t, kRadix>> counts(chunks);
+    for (unsigned shift = 0; shift < 8 * sizeof(T); shift += 8) {
+      auto digit = [shift](T v) {
+        U key = static_cast<U>(v);
+        if constexpr (std::is_signed_v<T>) key ^= U(1) << (8 * sizeof(T) - 1);
+        return static_cast<size_t>((key >> shift) & (kRadix - 1));
+      };
+      const T* s = src->data();
+      forEachChunk(chunks, [&](size_t c) {
+        auto& h = counts[c];
+        h.fill(0);
+        for (size_t i = chunkBegin(c, chunks, n), e = chunkBegin(c + 1, chunks, n); i < e; ++i) ++h[digit(s[i])];
+      });
+
+      size_t offset = 0;
+      bool trivial = false;
+      for (size_t d = 0; d < kRadix; ++d) {
+        size_t total = 0;
+        for (size_t c = 0; c < chunks; ++c) {
+          const size_t cnt = counts[c][d];
+          counts[c][d] = offset + total;
+          total += cnt;
+        }
+        trivial = trivial || total == n;
+        offset += total;
+      }
+      if (trivial) continue;
+
+      T* d = dst->data();
+      forEachChunk(chunks, [&](size_t c) {
+        auto& pos = counts[c];
+        for (size_t i = chunkBegin(c, chunks, n), e = chunkBegin(c + 1, chunks, n); i < e; ++i) d[pos[digit(s[i])]++] = s[i];
+      });
+      std::swap(src, dst);
+    }
+    if (src != &out) out.swap(tmp);
+    parallel_detail::release(buffers, std::move(tmp));
+    return out;
+  }
+};
+
+/**
+ * @struct ParallelHistogram
+ * @brief Счётчики по корзинам: out[key(x)] — число элементов с этим ключом
+ * (группировка со счётом). Ключ вне [0, bins) — std::out_of_range.
+ *
+ * Куски считают локальные гистограммы, которые затем складываются по корзинам.
+ */
+template<typename T, typename Key>
+struct ParallelHistogram {
+  size_t bins = 0;
+  Key key{};
+  size_t grain = kParallelGrain;
+
+  std::vector<uint64_t> operator()(const std::vector<T>& in) const {
+    const size_t n = in.size();
+    const size_t chunks = parallelChunks(n, grain);
+    std::vector<std::vector<uint64_t>> local(chunks);
+    forEachChunk(chunks, [&](size_t c) {
+      std::vector<uint64_t>& h = local[c];
+      h.assign(bins, 0);
+      for (size_t i = chunkBegin(c, chunks, n), e = chunkBegin(c + 1, chunks, n); i < e; ++i) {
+        const size_t b = static_cast<size_t>(key(in[i]));
+        if (b >= bins) throw std::out_of_range("ParallelHistogram: key out of range");
+        ++h[b];
+      }
+    });
+
+    std::vector<uint64_t> out = std::move(local[0]);
+    const size_t binChunks = parallelChunks(bins, grain);
+    forEachChunk(binChunks, [&](size_t c) {
+      for (size_t part = 1; part < chunks; ++part) {
+        for (size_t b = chunkBegin(c, binChunks, bins), e = chunkBegin(c + 1, binChunks, bins); b < e; ++b) {
+          out[b] += local[part][b];
+        }
+      }
+    });
+    return out;
+  }
+};
+
+/// Результат StablePartition: сначала элементы с pred == true, с позиции split — остальные.
+template<typename T>
+struct Partitioned {
+  std::vector<T> values;
+  size_t split = 0;
+};
+
+template<typename T>
+struct result_size<Partitioned<T>> {
+  static size_t bytes(const Partitioned<T>& p) {
+    return sizeof(Partitioned<T>) - sizeof(std::vector<T>) + result_size<std::vector<T>>::bytes(p.values);
+  }
+};
+
+/**
+ * @struct StablePartition
+ * @brief Устойчивое разбиение по pred, как std::stable_partition, но в новый буфер.
+ *
+ * Куски считают свои «истинные» элементы, смещения кусков — префиксная сумма
+ * этих счётчиков, затем каждый кусок раскладывает элементы на свои места.
+ * pred вызывается дважды на элемент.
+ */
+template<typename T, typename Pred>
+struct StablePartition {
+  Pred pred{};
+  size_t grain = kParallelGrain;
+  BufferHandle buffers{};
+
+  Partitioned<T> operator()(const std::vector<T>& in) const {
+    const size_t n = in.size();
+    Partitioned<T> out{parallel_detail::acquire<T>(buffers, n), 0};
+    const size_t chunks = parallelChunks(n, grain);
+    std::vector<size_t> trues(chunks + 1, 0);
+    forEachChunk(chunks, [&](size_t c) {
+      size_t count = 0;
+      for (size_t i = chunkBegin(c, chunks, n), e = chunkBegin(c + 1, chunks, n); i < e; ++i) count += pred(in[i]) ? 1 : 0;
+      trues[c + 1] = count;
+    });
+    for (size_t c = 0; c < chunks; ++c) trues[c + 1] += trues[c];
+    out.split = trues[chunks];
+
+    forEachChunk(chunks, [&](size_t c) {
+      const size_t first = chunkBegin(c, chunks, n);
+      size_t t = trues[c], f = out.split + (first - trues[c]);
+      for (size_t i = first, e = chunkBegin(c + 1, chunks, n); i < e; ++i) {
+        if (pred(in[i])) {
+          out.values[t++] = in[i];
+        } else {
+          out.values[f++] = in[i];
+        }
+      }
+    });
+    return out;
+  }
+};
+
+#endif // PARALLEL_ALGORITHMS_HPP
@@ -0,0 +1,22 @@
+#ifndef QUADRATIC_KERNELS_HPP
+#define QUADRATIC_KERNELS_HPP
+
+#include <cmath>
+
+/**
+ * @file quadratic_kernels.hpp
+ * @brief Ядра графа quadratic.graph: корни ax^2 + bx + c из README, разбитые на шаги.
+ */
+
+namespace quadratic_kernels {
+
+inline float minus4ac(float a, float c) { return -4 * a * c; }
+inline float discriminant(float b, float v) { return b * b + v; }
+inline float rootPlus(float b, float d) { return -b + std::sqrt(d); }
+inline float rootMinus(float b, float d) { return -b - std::sqrt(d); }
+inline float divide2a(float a, float v) { return v / (2 * a); }
+inline float plus3(float v) { return v + 3; }
+
+}  // namespace quadratic_kernels
+
+#endif // QUADRATIC_KERNELS_HPP
@@ -0,0 +1,148 @@
+#ifndef RANDOM_DAG_HPP
+#define RANDOM_DAG_HPP
+
+#include "task_scheduler.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @file random_dag.hpp
+ * @brief Генератор воспроизводимых случайных DAG для нагрузочной проверки
+ * TTaskScheduler: сам граф, эталонные значения всех узлов и перенос графа в шедулер.
+ *
+ * Генератор не использует std::*_distribution (их результат зависит от
+ * реализации стандартной библиотеки), поэтому по одному seed на любой
+ * платформе получается один и тот же граф.
+ */
+
+struct RandomDagConfig {
+  size_t nodes = 1000;
+  size_t depth = 32;           ///< число уровней; узел берёт входы только с предыдущих уровней
+  double leafFraction = 0.05;  ///< доля узлов без входов вне нулевого уровня
+  double fanIn = 1.5;          ///< среднее число входов у не-листа, от 1 до 2 (арность задач не больше 2)
+  double locality = 0.5;       ///< вероятность взять вход с соседнего уровня; остальные — геометрически дальше
+  double fanOutSkew = 0;       ///< 0 — вход выбирается равномерно; больше — всё сильнее тянется к немногим «хабам»
+  uint32_t cost = 0;           ///< средняя стоимость узла, раундов перемешивания
+  bool costJitter = true;      ///< стоимость узла равномерна в [0, 2 * cost]
+  uint64_t seed = 1;
+};
+
+/**
+ * @class RandomDag
+ * @brief Случайный DAG: узлы идут уровнями, входы узла всегда имеют меньший id.
+ *
+ * Значение листа — хеш seed и id, остальных — хеш значений входов и id,
+ * прогнанный cost раундов. Поэтому любая ошибка порядка выполнения или
+ * передачи аргументов меняет значения всех потомков.
+ */
+class RandomDag {
+public:
+  struct Node {
+    uint32_t inputs[2];
+    uint32_t cost;
+    uint8_t arity;
+  };
+
+  explicit RandomDag(const RandomDagConfig& c) : config(c) {
+    nodes.resize(c.nodes);
+    const size_t depth = std::max<size_t>(1, std::min(c.depth, c.nodes));
+    width = (c.nodes + depth - 1) / depth;
+    uint64_t state = c.seed;
+    for (size_t i = 0; i < c.nodes; ++i) {
+      Node& n = nodes[i];
+      n.cost = c.cost == 0 ? 0 : c.costJitter ? static_cast<uint32_t>(next(state) % (2 * uint64_t(c.cost) + 1)) : c.cost;
+      const size_t level = i / width;
+      n.arity = 0;
+      if (level == 0 || unit(state) < c.leafFraction) continue;
+      n.arity = unit(state) < c.fanIn - 1 ? 2 : 1;
+      for (uint8_t k = 0; k < n.arity; ++k) n.inputs[k] = static_cast<uint32_t>(pickInput(level, state));
+    }
+  }
+
+  size_t size() const { return nodes.size(); }
+  const Node& operator[](size_t i) const { return nodes[i]; }
+
+  /// Значение узла i по значениям его входов.
+  uint64_t value(size_t i, uint64_t a = 0, uint64_t b = 0) const {
+    const Node& n = nodes[i];
+    uint64_t v = n.arity == 0 ? mix(config.seed ^ (i * kGolden))
+               : n.arity == 1 ? mix(a + i * kGolden)
+                              : mix(a ^ ((b << 17) | (b >> 47)) ^ (i * kGolden));
+    for (uint32_t k = 0; k < n.cost; ++k) v = mix(v);
+    return v;
+  }
+
+  /// Эталон: значения всех узлов, посчитанные напрямую в порядке id.
+  std::vector<uint64_t> evaluate() const {
+    std::vector<uint64_t> out(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      const Node& n = nodes[i];
+      out[i] = value(i, n.arity > 0 ? out[n.inputs[0]] : 0, n.arity > 1 ? out[n.inputs[1]] : 0);
+    }
+    return out;
+  }
+
+  /**
+   * @brief Добавляет узлы [from, to) в шедулер; id узла совпадает с id задачи,
+   * поэтому шедулер должен быть пуст, а диапазоны добавляться по порядку.
+   */
+  void addTo(TTaskScheduler& sched, size_t from, size_t to) const {
+    for (size_t i = from; i < to; ++i) {
+      const Node& n = nodes[i];
+      const Eval f{this, static_cast<uint32_t>(i)};
+      if (n.arity == 0) {
+        sched.add(f);
+      } else if (n.arity == 1) {
+        sched.add(f, sched.getFutureResult<uint64_t>(n.inputs[0]));
+      } else {
+        sched.add(f, sched.getFutureResult<uint64_t>(n.inputs[0]), sched.getFutureResult<uint64_t>(n.inputs[1]));
+      }
+    }
+  }
+
+  void addTo(TTaskScheduler& sched) const { addTo(sched, 0, nodes.size()); }
+
+  static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+private:
+  static constexpr uint64_t kGolden = 0x9e3779b97f4a7c15ULL;
+
+  /// Callable задачи: одно и то же для всех узлов, поэтому все узлы — один вид.
+  struct Eval {
+    const RandomDag* dag;
+    uint32_t id;
+
+    uint64_t operator()() const { return dag->value(id); }
+    uint64_t operator()(uint64_t a) const { return dag->value(id, a); }
+    uint64_t operator()(uint64_t a, uint64_t b) const { return dag->value(id, a, b); }
+  };
+
+  RandomDagConfig config;
+  std::vector<Node> nodes;
+  size_t width = 1;
+
+  static uint64_t next(uint64_t& state) { return mix(state += kGolden); }
+  static double unit(uint64_t& state) { return static_cast<double>(next(state) >> 11) * 0x1.0p-53; }
+
+  size_t pickInput(size_t level, uint64_t& state) const {
+    // Расстояние до уровня входа — геометрическое: 1 с вероятностью locality.
+    size_t distance = 1;
+    if (config.locality < 1) {
+      const double u = unit(state);
+      distance += static_cast<size_t>(std::log1p(-u) / std::log1p(-std::max(config.locality, 1e-9)));
+    }
+    const size_t source = level - std::min(distance, level);
+    const double u = std::pow(unit(state), 1 + config.fanOutSkew);
+    return source * width + std::min(static_cast<size_t>(u * static_cast<double>(width)), width - 1);
+  }
+};
+
+#endif // RANDOM_DAG_HPP
@@ -0,0 +1,214 @@
+/**
+ * @file stress.cpp
+ * @brief Нагрузочный прогон TTaskScheduler на больших случайных DAG.
+ *
+ * Один и тот же граф (random_dag.hpp) прогоняется в нескольких режимах,
+ * значения всех узлов сверяются с эталоном, для каждого режима печатаются
+ * время добавления задач, время вычисления и пиковый RSS. Каждый режим
+ * выполняется в отдельном дочернем процессе, чтобы пиковый RSS был его собственным.
+ *
+ * Режимы:
+ *  - seq — без пула, executeAll();
+ *  - par — пул из --threads потоков, executeAll();
+ *  - inc — граф добавляется --chunks частями, после каждой executeAll() (с пулом, если --threads > 0);
+ *  - lazy — getResult() последнего узла каждого уровня (с пулом, если --threads > 0).
+ *
+ * Для сравнения сборок на одном и том же расписании: `--record=PATH` сохраняет
+ * расписание каждого режима с пулом в PATH.<режим>, `--replay=PATH` воспроизводит
+ * его (граф и параметры должны совпадать), `--schedule-seed=S` задаёт
+ * детерминированную псевдослучайную политику (см. TTaskScheduler::replaySchedule).
+ *
+ * Пример: `./stress --nodes=10000000 --depth=1000 --threads=8 --modes=seq,par,inc`.
+ * Код возврата 1, если хоть один режим разошёлся с эталоном.
+ */
+
+#include "task_scheduler.hpp"
+#include "random_dag.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+struct Options {
+  RandomDagConfig dag;
+  size_t threads = std::max(2u, std::thread::hardware_concurrency());
+  size_t chunks = 4;
+  std::string modes = "seq,par,inc,lazy";
+  std::string record;
+  std::string replay;
+  uint64_t scheduleSeed = 0;  ///< 0 — обычное динамическое планирование
+};
+
+/// Результат режима, передаётся из дочернего процесса через pipe.
+struct ModeResult {
+  double buildSeconds = 0;
+  double runSeconds = 0;
+  uint64_t mismatches = 0;
+  uint64_t checked = 0;
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+ModeResult runMode(std::string_view mode, const Options& opt, const RandomDag& dag,
+                   const std::vector<uint64_t>& expected) {
+  ModeResult r;
+  const bool pooled = mode != "seq";
+  TTaskScheduler sched(pooled ? opt.threads : 0);
+  const size_t n = dag.size();
+  const std::string schedulePath = "." + std::string(mode);
+  if (pooled && !opt.replay.empty()) {
+    TTaskScheduler::Schedule schedule;
+    if (!schedule.load(opt.replay + schedulePath)) throw std::runtime_error("No schedule " + opt.replay + schedulePath);
+    sched.replaySchedule(std::move(schedule));
+  } else if (pooled && opt.scheduleSeed != 0) {
+    sched.randomSchedule(opt.scheduleSeed);
+  }
+  if (pooled && !opt.record.empty()) sched.recordSchedule();
+
+  if (mode == "inc") {
+    // Добавление и вычисление чередуются: следующая часть опирается на уже вычисленные узлы.
+    for (size_t c = 0; c < opt.chunks; ++c) {
+      const size_t from = n * c / opt.chunks, to = n * (c + 1) / opt.chunks;
+      auto start = std::chrono::steady_clock::now();
+      dag.addTo(sched, from, to);
+      r.buildSeconds += secondsSince(start);
+      start = std::chrono::steady_clock::now();
+      sched.executeAll();
+      r.runSeconds += secondsSince(start);
+    }
+  } else {
+    auto start = std::chrono::steady_clock::now();
+    dag.addTo(sched);
+    r.buildSeconds = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    if (mode == "lazy") {
+      const size_t width = (n + opt.dag.depth - 1) / std::max<size_t>(1, opt.dag.depth);
+      for (size_t last = std::min(width, n); ; last = std::min(last + width, n)) {
+        sched.getResult<uint64_t>(last - 1);
+        if (last == n) break;
+      }
+    } else {
+      sched.executeAll();
+    }
+    r.runSeconds = secondsSince(start);
+  }
+
+  if (pooled && !opt.record.empty()) sched.recordedSchedule().save(opt.record + schedulePath);
+
+  // В ленивом режиме вычислена только часть графа: сверяем то, что вычислено.
+  const auto stats = sched.stats();
+  if (mode != "lazy" && stats.executions != n) ++r.mismatches;
+  for (size_t i = 0; i < n; ++i) {
+    if (mode == "lazy" && i % 97 != 0 && i + 1 != n) continue;
+    ++r.checked;
+    if (sched.getResult<uint64_t>(i) != expected[i]) ++r.mismatches;
+  }
+  return r;
+}
+
+bool parse(int argc, char** argv, Options& opt) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const size_t eq = arg.find('=');
+    if (arg.substr(0, 2) != "--" || eq == std::string_view::npos) return false;
+    const std::string key(arg.substr(2, eq - 2));
+    const char* value = argv[i] + eq + 1;
+    if (key == "nodes") opt.dag.nodes = std::strtoull(value, nullptr, 10);
+    else if (key == "depth") opt.dag.depth = std::strtoull(value, nullptr, 10);
+    else if (key == "leaf") opt.dag.leafFraction = std::strtod(value, nullptr);
+    else if (key == "fanin") opt.dag.fanIn = std::strtod(value, nullptr);
+    else if (key == "locality") opt.dag.locality = std::strtod(value, nullptr);
+    else if (key == "skew") opt.dag.fanOutSkew = std::strtod(value, nullptr);
+    else if (key == "cost") opt.dag.cost = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+    else if (key == "seed") opt.dag.seed = std::strtoull(value, nullptr, 10);
+    else if (key == "threads") opt.threads = std::strtoull(value, nullptr, 10);
+    else if (key == "chunks") opt.chunks = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+    else if (key == "modes") opt.modes = value;
+    else if (key == "record") opt.record = value;
+    else if (key == "replay") opt.replay = value;
+    else if (key == "schedule-seed") opt.scheduleSeed = std::strtoull(value, nullptr, 10);
+    else return false;
+  }
+  return opt.dag.nodes > 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  if (!parse(argc, argv, opt)) {
+    std::fprintf(stderr,
+                 "usage: %s [--nodes=N] [--depth=D] [--leaf=F] [--fanin=1..2] [--locality=P] [--skew=S]\n"
+                 "          [--cost=ROUNDS] [--seed=S] [--threads=T] [--chunks=C] [--modes=seq,par,inc,lazy]\n"
+                 "          [--record=PATH | --replay=PATH | --schedule-seed=S]\n",
+                 argv[0]);
+    return 2;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  const RandomDag dag(opt.dag);
+  const std::vector<uint64_t> expected = dag.evaluate();
+  rusage self{};
+  ::getrusage(RUSAGE_SELF, &self);
+  std::printf("graph: %zu nodes, depth %zu, seed %llu, generated and evaluated directly in %.3f s\n"
+              "graph and reference values: %.1f MB RSS (included in each mode's peak)\n",
+              dag.size(), opt.dag.depth, static_cast<unsigned long long>(opt.dag.seed), secondsSince(start),
+              static_cast<double>(self.ru_maxrss) / 1024);
+  std::printf("%-5s %10s %10s %12s %14s %s\n", "mode", "build, s", "run, s", "Mtasks/s", "peak RSS, MB", "check");
+  std::fflush(stdout);
+
+  bool ok = true;
+  for (size_t pos = 0; pos <= opt.modes.size();) {
+    const size_t comma = std::min(opt.modes.find(',', pos), opt.modes.size());
+    const std::string mode = opt.modes.substr(pos, comma - pos);
+    pos = comma + 1;
+    if (mode != "seq" && mode != "par" && mode != "inc" && mode != "lazy") {
+      std::fprintf(stderr, "unknown mode '%s'\n", mode.c_str());
+      return 2;
+    }
+
+    int fds[2];
+    if (::pipe(fds) != 0) return 2;
+    const pid_t child = ::fork();
+    if (child == 0) {
+      ::close(fds[0]);
+      const ModeResult r = runMode(mode, opt, dag, expected);
+      const bool written = ::write(fds[1], &r, sizeof(r)) == static_cast<ssize_t>(sizeof(r));
+      ::_exit(written ? 0 : 1);
+    }
+    ::close(fds[1]);
+    ModeResult r;
+    const bool received = ::read(fds[0], &r, sizeof(r)) == static_cast<ssize_t>(sizeof(r));
+    ::close(fds[0]);
+    int status = 0;
+    rusage usage{};
+    ::wait4(child, &status, 0, &usage);
+    if (!received || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      std::printf("%-5s crashed (status %d)\n", mode.c_str(), status);
+      ok = false;
+      continue;
+    }
+
+    const double rate = r.runSeconds > 0 ? static_cast<double>(dag.size()) / r.runSeconds * 1e-6 : 0;
+    std::printf("%-5s %10.3f %10.3f %12.2f %14.1f %s\n", mode.c_str(), r.buildSeconds, r.runSeconds,
+                mode == "lazy" ? 0.0 : rate, static_cast<double>(usage.ru_maxrss) / 1024,
+                r.mismatches ? "MISMATCH" : "ok");
+    std::fflush(stdout);
+    ok = ok && r.mismatches == 0;
+  }
+  return ok ? 0 : 1;
+}
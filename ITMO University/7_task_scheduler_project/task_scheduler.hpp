@@ -2,14 +2,46 @@
 #define TASK_SCHEDULER_HPP
 
 #include <vector>
+#include <deque>
+#include <atomic>
+#include <unordered_map>
+#include <array>
 #include <memory>
 #include <tuple>
 #include <utility>
 #include <stdexcept>
 #include <type_traits>
 #include <functional>
+#include <typeinfo>
+#include <typeindex>
 #include <cmath>
 #include <memory>
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <semaphore>
+#include <span>
+#include <bit>
+#include <exception>
+#include <new>
+#include <cstddef>
+#include <variant>
+#include <optional>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <cassert>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#endif
 
 /**
  * @file task_scheduler.hpp
@@ -18,22 +50,459 @@
  * Документация на русском языке и Doxygen-совместимые DocString'и присутствуют в этом файле.
  */
 
+/**
+ * @class ThreadCache
+ * @brief Поточно-локальный аллокатор мелких блоков (16 байт .. 4 КБ).
+ *
+ * Каждый поток, которому нужна память (рабочие потоки пула, вызывающий поток),
+ * получает свой кеш: блоки нарезаются из регионов по 64 КБ и раздаются из
+ * списков свободных блоков по классам размера без блокировок и без обращения к
+ * malloc. Заголовок блока помнит кеш-владельца. Блок, освобождённый в чужом
+ * потоке (типичный случай: результат создан на рабочем потоке, а освобождён
+ * координатором при reset), копится в поточно-локальной пачке и уходит владельцу
+ * одним CAS на kRemoteBatch блоков; владелец забирает чужие освобождения целиком,
+ * когда у него кончается класс. Кеш завершившегося потока не уничтожается, а
+ * переходит следующему новому потоку вместе с регионами и ждущими освобождениями.
+ *
+ * Через кеш выделяются обёртки результатов AnyValue; для временной памяти задач
+ * есть CachedAllocator<T>. setEnabled(false) переключает выделения на глобальный
+ * operator new (для сравнения в бенчмарках).
+ */
+class ThreadCache {
+public:
+  static constexpr size_t kHeader = 16;
+  static constexpr size_t kMinShift = 4;
+  static constexpr size_t kClasses = 9;
+  static constexpr size_t kMaxBlock = size_t(1) << (kMinShift + kClasses - 1);
+  static constexpr size_t kRegionBytes = size_t(64) << 10;
+  static constexpr size_t kRemoteBatch = 64;
+
+  struct Stats {
+    size_t allocations = 0;     ///< выделения из этого кеша
+    size_t regionBytes = 0;     ///< память, взятая у operator new под регионы
+    size_t remoteReclaimed = 0; ///< блоки, освобождённые другими потоками и вернувшиеся сюда
+  };
+
+  static void* allocate(size_t bytes) {
+    if (bytes > kMaxBlock || !enabled().load(std::memory_order_relaxed)) {
+      auto* h = static_cast<Header*>(::operator new(bytes + kHeader));
+      h->owner = nullptr;
+      return reinterpret_cast<char*>(h) + kHeader;
+    }
+    const size_t cls = bytes <= (size_t(1) << kMinShift)
+        ? 0 : static_cast<size_t>(std::bit_width((bytes - 1) >> kMinShift));
+    return local().allocateSmall(cls);
+  }
+
+  static void deallocate(void* p) noexcept {
+    if (!p) return;
+    auto* h = reinterpret_cast<Header*>(static_cast<char*>(p) - kHeader);
+    if (!h->owner) {
+      ::operator delete(h);
+    } else if (h->owner == current()) {
+      h->owner->pushLocal(h);
+    } else {
+      batch().add(h);
+    }
+  }
+
+  /// Кеш текущего потока (создаётся или наследуется при первом обращении).
+  static ThreadCache& local() {
+    thread_local Binding binding;
+    return *binding.cache;
+  }
+
+  /// Отправляет владельцам накопленные в этом потоке чужие освобождения.
+  static void flushRemoteFrees() { batch().flush(); }
+
+  static void setEnabled(bool on) { enabled().store(on, std::memory_order_relaxed); }
+
+  /// Забирает освобождения других потоков; возвращает число вернувшихся блоков.
+  size_t reclaimRemote() {
+    size_t n = 0;
+    Header* h = remote.exchange(nullptr, std::memory_order_acquire);
+    while (h) {
+      Header* next = h->next;
+      pushLocal(h);
+      h = next;
+      ++n;
+    }
+    stats.remoteReclaimed += n;
+    return n;
+  }
+
+  const Stats& localStats() const { return stats; }
+
+private:
+  /// Заголовок блока; next используется, пока блок свободен.
+  struct Header {
+    ThreadCache* owner;
+    Header* next;
+  };
+  static_assert(sizeof(Header) <= kHeader, "заголовок не помещается в kHeader байт");
+
+  /// Пачка освобождений для одного чужого кеша.
+  struct RemoteBatch {
+    ThreadCache* target = nullptr;
+    Header* head = nullptr;
+    Header* tail = nullptr;
+    size_t count = 0;
+
+    ~RemoteBatch() { flush(); }
+
+    void add(Header* h) {
+      if (h->owner != target) flush();
+      target = h->owner;
+      h->next = head;
+      head = h;
+      if (!tail) tail = h;
+      if (++count >= kRemoteBatch) flush();
+    }
+
+    void flush() {
+      if (!head) return;
+      Header* top = target->remote.load(std::memory_order_relaxed);
+      do {
+        tail->next = top;
+      } while (!target->remote.compare_exchange_weak(top, head, std::memory_order_release, std::memory_order_relaxed));
+      head = tail = nullptr;
+      count = 0;
+    }
+  };
+
+  /// Привязка кеша к потоку: при выходе потока кеш уходит в общий список свободных.
+  struct Binding {
+    ThreadCache* cache;
+    Binding() : cache(adopt()) { current() = cache; }
+    ~Binding() {
+      current() = nullptr;
+      Registry& r = registry();
+      std::lock_guard<std::mutex> lk(r.m);
+      r.orphans.push_back(cache);
+    }
+  };
+
+  struct Registry {
+    std::mutex m;
+    std::vector<ThreadCache*> orphans;
+  };
+
+  std::array<Header*, kClasses> freeLists{};
+  std::atomic<Header*> remote{nullptr};
+  std::vector<void*> regions;
+  Stats stats;
+
+  ThreadCache() = default;
+
+  static std::atomic<bool>& enabled() {
+    static std::atomic<bool> on{true};
+    return on;
+  }
+
+  static ThreadCache*& current() {
+    thread_local ThreadCache* cache = nullptr;
+    return cache;
+  }
+
+  static RemoteBatch& batch() {
+    thread_local RemoteBatch b;
+    return b;
+  }
+
+  // Кеши живут до конца процесса и переходят от потока к потоку.
+  static Registry& registry() {
+    static Registry* r = new Registry();
+    return *r;
+  }
+
+  static ThreadCache* adopt() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.m);
+    if (r.orphans.empty()) return new ThreadCache();
+    ThreadCache* c = r.orphans.back();
+    r.orphans.pop_back();
+    return c;
+  }
+
+  void pushLocal(Header* h) {
+    const size_t cls = classOf(h);
+    h->next = freeLists[cls];
+    freeLists[cls] = h;
+  }
+
+  // Класс блока хранится в регионе: все блоки региона одного класса.
+  size_t classOf(Header* h) const {
+    return reinterpret_cast<const RegionHeader*>(
+        reinterpret_cast<uintptr_t>(h) & ~(uintptr_t(kRegionBytes) - 1))->cls;
+  }
+
+  struct RegionHeader {
+    size_t cls;
+  };
+
+  void* allocateSmall(size_t cls) {
+    ++stats.allocations;
+    if (!freeLists[cls]) reclaimRemote();
+    if (!freeLists[cls]) carveRegion(cls);
+    Header* h = freeLists[cls];
+    freeLists[cls] = h->next;
+    h->owner = this;
+    return reinterpret_cast<char*>(h) + kHeader;
+  }
+
+  // Регион выровнен на свой размер, поэтому класс блока находится по адресу.
+  void carveRegion(size_t cls) {
+    char* region = static_cast<char*>(::operator new(kRegionBytes, std::align_val_t(kRegionBytes)));
+    regions.push_back(region);
+    stats.regionBytes += kRegionBytes;
+    reinterpret_cast<RegionHeader*>(region)->cls = cls;
+
+    const size_t block = kHeader + (size_t(1) << (kMinShift + cls));
+    for (size_t off = kHeader; off + block <= kRegionBytes; off += block) {
+      auto* h = reinterpret_cast<Header*>(region + off);
+      h->owner = this;
+      h->next = freeLists[cls];
+      freeLists[cls] = h;
+    }
+  }
+};
+
+/**
+ * @brief Стандартный аллокатор поверх ThreadCache — для временной памяти задач
+ * (например, std::vector<int, CachedAllocator<int>>) и обёрток результатов.
+ * Типы с выравниванием больше 16 байт идут через std::allocator.
+ */
+template<typename T>
+struct CachedAllocator {
+  using value_type = T;
+
+  CachedAllocator() = default;
+  template<typename U>
+  CachedAllocator(const CachedAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    if constexpr (alignof(T) > ThreadCache::kHeader) return std::allocator<T>().allocate(n);
+    else return static_cast<T*>(ThreadCache::allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    if constexpr (alignof(T) > ThreadCache::kHeader) std::allocator<T>().deallocate(p, n);
+    else ThreadCache::deallocate(p);
+  }
+
+  template<typename U>
+  bool operator==(const CachedAllocator<U>&) const { return true; }
+};
+
+/**
+ * @class BufferPool
+ * @brief Пул переиспользуемых буферов std::vector<T> с разбиением по размерам.
+ *
+ * Буферы хранятся отдельно для каждого T и по классам размера (степени двойки
+ * ёмкости). acquire<T>(n) берёт буфер ёмкостью не меньше n из класса
+ * ceil(log2 n), release кладёт буфер в класс floor(log2 capacity). Страницы
+ * переиспользованного буфера уже отображены, поэтому повторные прогоны одного и
+ * того же конвейера не платят за page fault'ы и malloc. Буферы меньше
+ * kMinBytes пулу не нужны — их дешевле отдать malloc. Потокобезопасен.
+ */
+class BufferPool {
+public:
+  static constexpr size_t kMinBytes = 4096;
+
+  /// @param retainLimitBytes сколько байт пул держит у себя, лишнее освобождается.
+  explicit BufferPool(size_t retainLimitBytes = size_t(1) << 30) : retainLimit(retainLimitBytes) {}
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  struct Stats {
+    size_t hits = 0;           ///< acquire обслужен из пула
+    size_t misses = 0;         ///< acquire выделил новый буфер
+    size_t retainedBytes = 0;  ///< ёмкость буферов, лежащих в пуле
+  };
+
+  /// Вектор размера n; буфер берётся из пула, если там есть подходящий.
+  template<typename T>
+  std::vector<T> acquire(size_t n) {
+    if (n == 0) return {};
+    const size_t k = static_cast<size_t>(std::bit_width(n - 1));
+    std::vector<T> v;
+    {
+      std::lock_guard<std::mutex> lk(m);
+      auto& bucket = buckets<T>().bySize[k];
+      if (!bucket.empty()) {
+        v = std::move(bucket.back());
+        bucket.pop_back();
+        retained -= v.capacity() * sizeof(T);
+        ++hits;
+      } else {
+        ++misses;
+      }
+    }
+    // Новый буфер сразу занимает весь класс: вернувшись в пул, он подойдёт любому n из него.
+    if (v.capacity() == 0) v.reserve(size_t(1) << k);
+    v.resize(n);
+    return v;
+  }
+
+  /// Возвращает буфер в пул; содержимое уничтожается, ёмкость сохраняется.
+  template<typename T>
+  void release(std::vector<T>&& v) {
+    const size_t bytes = v.capacity() * sizeof(T);
+    if (bytes < kMinBytes) return;
+    v.clear();
+    std::lock_guard<std::mutex> lk(m);
+    if (retained + bytes > retainLimit) return;
+    buckets<T>().bySize[static_cast<size_t>(std::bit_width(v.capacity())) - 1].push_back(std::move(v));
+    retained += bytes;
+  }
+
+  Stats stats() const {
+    std::lock_guard<std::mutex> lk(m);
+    return {hits, misses, retained};
+  }
+
+  /// Освобождает все буферы пула.
+  void clear() {
+    std::lock_guard<std::mutex> lk(m);
+    types.clear();
+    retained = 0;
+  }
+
+private:
+  struct BucketsBase {
+    virtual ~BucketsBase() = default;
+  };
+
+  template<typename T>
+  struct Buckets : BucketsBase {
+    std::array<std::vector<std::vector<T>>, 64> bySize;
+  };
+
+  mutable std::mutex m;
+  std::unordered_map<std::type_index, std::unique_ptr<BucketsBase>> types;
+  size_t retainLimit;
+  size_t retained = 0;
+  size_t hits = 0;
+  size_t misses = 0;
+
+  template<typename T>
+  Buckets<T>& buckets() {
+    auto& slot = types[std::type_index(typeid(T))];
+    if (!slot) slot = std::make_unique<Buckets<T>>();
+    return static_cast<Buckets<T>&>(*slot);
+  }
+};
+
+/**
+ * @class BufferHandle
+ * @brief Лёгкий копируемый доступ задачи к BufferPool шедулера.
+ *
+ * Передаётся задаче обычным аргументом: sched.add(f, sched.buffers(), n).
+ * Без пула (пустой handle) acquire просто создаёт новый вектор.
+ */
+class BufferHandle {
+public:
+  explicit BufferHandle(BufferPool* p = nullptr) : pool(p) {}
+
+  template<typename T>
+  std::vector<T> acquire(size_t n) const { return pool ? pool->template acquire<T>(n) : std::vector<T>(n); }
+
+  BufferPool* get() const { return pool; }
+
+private:
+  BufferPool* pool;
+};
+
+template<typename T>
+struct is_recyclable_buffer : std::false_type {};
+
+template<typename T>
+struct is_recyclable_buffer<std::vector<T>> : std::true_type {};
+
+template<typename T, typename = void>
+struct has_capacity : std::false_type {};
+
+template<typename T>
+struct has_capacity<T, std::void_t<typename T::value_type, decltype(std::declval<const T&>().capacity())>>
+  : std::true_type {};
+
+template<typename T, typename = void>
+struct is_node_container : std::false_type {};
+
+template<typename T>
+struct is_node_container<T, std::void_t<typename T::node_type, typename T::value_type, decltype(std::declval<const T&>().size())>>
+  : std::true_type {};
+
+/**
+ * @brief Оценка памяти, которую держит значение-результат. На ней построен
+ * весь учёт памяти шедулера: бюджет пересчёта, модель стоимости, отчёт footprint().
+ *
+ * По умолчанию: sizeof(T); для контейнеров с capacity() (vector, string) —
+ * плюс capacity() элементов, для узловых контейнеров (map, set, unordered_*) —
+ * плюс size() узлов по элементу и два указателя. Вложенные контейнеры
+ * считаются рекурсивно. Для своих типов, владеющих памятью, специализируйте
+ * result_size<T>::bytes.
+ */
+template<typename T>
+struct result_size {
+  static size_t bytes(const T& v) {
+    if constexpr (has_capacity<T>::value || is_node_container<T>::value) {
+      using V = typename T::value_type;
+      size_t total = sizeof(T);
+      if constexpr (has_capacity<T>::value) total += v.capacity() * sizeof(V);
+      else total += v.size() * (sizeof(V) + 2 * sizeof(void*));
+      if constexpr (has_capacity<V>::value || is_node_container<V>::value) {
+        for (const auto& e : v) total += result_size<V>::bytes(e) - sizeof(V);
+      }
+      return total;
+    } else {
+      return sizeof(T);
+    }
+  }
+};
+
+/// Читаемое имя типа из type_info::name() (как есть, если demangle недоступен).
+inline std::string demangle(const char* name) {
+#if __has_include(<cxxabi.h>)
+  int status = 0;
+  char* readable = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+  if (status == 0 && readable) {
+    std::string out(readable);
+    std::free(readable);
+    return out;
+  }
+#endif
+  return name;
+}
+
 /**
  * @class AnyValue
  * @brief Простая реализация type-erasure для хранения произвольного значения.
  *
  * Используется для хранения результатов задач разного типа в одном контейнере.
+ * Обёртка значения выделяется через ThreadCache потока, который создал результат.
  */
 class AnyValue {
   struct Base {
+    const std::type_info* type;
+    explicit Base(const std::type_info& t) : type(&t) {}
     virtual ~Base() = default;
+    virtual void recycle(BufferPool&) {}
+    virtual size_t bytes() const = 0;
   };
 
   template<typename T>
-  struct Holder : Base {
+  struct Holder final : Base {
     T value;
     template<typename U>
-    Holder(U&& v) : value(std::forward<U>(v)) {}
+    Holder(U&& v) : Base(typeid(T)), value(std::forward<U>(v)) {}
+
+    void recycle(BufferPool& pool) override {
+      if constexpr (is_recyclable_buffer<T>::value) pool.release(std::move(value));
+    }
+
+    size_t bytes() const override { return result_size<T>::bytes(value); }
   };
 
   std::shared_ptr<Base> ptr;
@@ -42,25 +511,50 @@ public:
   AnyValue() = default;
 
   template<typename T, typename = std::enable_if_t<!std::is_same<std::decay_t<T>, AnyValue>::value>>
-  AnyValue(T&& v) : ptr(std::make_shared<Holder<std::decay_t<T>>>(std::forward<T>(v))) {}
+  AnyValue(T&& v)
+    : ptr(std::allocate_shared<Holder<std::decay_t<T>>>(CachedAllocator<Holder<std::decay_t<T>>>(), std::forward<T>(v))) {}
 
   bool empty() const { return !ptr; }
 
+  /// Оценка занимаемой значением памяти (см. result_size).
+  size_t bytes() const { return ptr ? ptr->bytes() : 0; }
+
+  /// Тип значения; nullptr для пустого.
+  const std::type_info* type() const { return ptr ? ptr->type : nullptr; }
+
+  /// Очищает значение; буфер std::vector уходит в pool, если других ссылок на него нет.
+  void recycleInto(BufferPool& pool) {
+    if (ptr && ptr.use_count() == 1) ptr->recycle(pool);
+    ptr.reset();
+  }
+
+  // Holder финальный, поэтому сравнения type_info достаточно вместо dynamic_cast;
+  // обращение идёт по сырому указателю, без копии shared_ptr.
   template<typename T>
   T* try_cast() {
     using H = Holder<std::decay_t<T>>;
-    auto p = std::dynamic_pointer_cast<H>(ptr);
-    return p ? &p->value : nullptr;
+    if (!ptr || *ptr->type != typeid(std::decay_t<T>)) return nullptr;
+    return &static_cast<H*>(ptr.get())->value;
   }
 
   template<typename T>
   const T* try_cast() const {
     using H = Holder<std::decay_t<T>>;
-    auto p = std::dynamic_pointer_cast<H>(ptr);
-    return p ? &p->value : nullptr;
+    if (!ptr || *ptr->type != typeid(std::decay_t<T>)) return nullptr;
+    return &static_cast<const H*>(ptr.get())->value;
   }
 };
 
+/**
+ * @brief Тип id задачи внутри графа. С TASK_SCHEDULER_COMPACT_IDS — 32 бита:
+ * граф ограничен 2^32 - 1 задачами, зато узлы и аргументы-зависимости меньше.
+ */
+#if defined(TASK_SCHEDULER_COMPACT_IDS)
+using TaskId = uint32_t;
+#else
+using TaskId = size_t;
+#endif
+
 /**
  * @struct FutureResult
  * @brief Маркер зависимости на результат задачи с указанным id.
@@ -70,8 +564,13 @@ public:
  */
 template<typename T>
 struct FutureResult {
-  size_t id;
-  explicit FutureResult(size_t i = 0) : id(i) {}
+  TaskId id;
+  /// std::out_of_range, если i не помещается в TaskId (при TASK_SCHEDULER_COMPACT_IDS).
+  explicit FutureResult(size_t i = 0) : id(static_cast<TaskId>(i)) {
+    if constexpr (sizeof(TaskId) < sizeof(size_t)) {
+      if (i > std::numeric_limits<TaskId>::max()) throw std::out_of_range("Task id does not fit TaskId");
+    }
+  }
 };
 
 /**
@@ -84,161 +583,2696 @@ template<typename T>
 struct unwrap_future<FutureResult<T>> { using type = T; };
 
 /**
- * @class TTaskScheduler
- * @brief Шедулер задач с поддержкой зависимостей по результатам других задач.
+ * @struct Shared
+ * @brief Неизменяемое значение-аргумент, общее для всех задач, которым его передали.
  *
- * TTaskScheduler позволяет добавлять задачи — любые callable-объекты (функции, лямбды,
- * указатели на методы классов). Каждая задача может принимать не более двух аргументов.
- * Аргументы могут быть обычными значениями (они копируются/перемещаются при добавлении)
- * либо специальными объектами FutureResult<T>, которые указывают на результат другой задачи
- * (идентифицируемой по id). Когда задача добавлена, она не выполняется сразу — выполнение
- * происходит лениво при вызове getResult<T>(id) или принудительно методом executeAll().
+ * add() копирует обычные аргументы в каждую задачу; Shared<T> копирует только
+ * указатель, а callable получает const T& на единственный экземпляр.
+ */
+template<typename T>
+struct Shared {
+  std::shared_ptr<const T> ptr;
+  explicit Shared(std::shared_ptr<const T> p) : ptr(std::move(p)) {}
+};
+
+/**
+ * @struct Borrowed
+ * @brief Аргумент-ссылка на значение вызывающего кода без копирования и подсчёта ссылок.
  *
- * Особенности:
- *  - Результаты хранятся в обёртке AnyValue (type-erasure).
- *  - При попытке получить результат с неверным типом будет выброшено std::runtime_error.
- *  - При наличии циклических зависимостей вычисление приводит к std::runtime_error.
+ * Значение должно жить и не меняться, пока шедулер может выполнить задачу
+ * (в том числе повторно после reset()), то есть до уничтожения шедулера.
  */
-class TTaskScheduler {
+template<typename T>
+struct Borrowed {
+  const T* ptr;
+  explicit Borrowed(const T& v) : ptr(&v) {}
+};
+
+/// Переносит значение в общий неизменяемый экземпляр для передачи в add().
+template<typename T>
+Shared<std::decay_t<T>> share(T&& v) {
+  return Shared<std::decay_t<T>>(std::make_shared<const std::decay_t<T>>(std::forward<T>(v)));
+}
+
+/// Передаёт значение в add() по ссылке; см. контракт времени жизни у Borrowed.
+template<typename T>
+Borrowed<T> borrow(const T& v) { return Borrowed<T>(v); }
+
+template<typename T>
+struct unwrap_future<Shared<T>> { using type = T; };
+
+template<typename T>
+struct unwrap_future<Borrowed<T>> { using type = T; };
+
+/**
+ * @class TaskBitset
+ * @brief Плотный битовый набор статусов задач (один бит на задачу).
+ *
+ * Поиск следующего установленного/сброшенного бита идёт по 64-битным словам через
+ * ctz, целиком заполненные слова пропускаются (при сборке с AVX2 — по четыре слова
+ * за инструкцию). На графах из десятков миллионов задач это в 8 раз меньше трафика
+ * памяти, чем bool на задачу.
+ */
+class TaskBitset {
 public:
-  TTaskScheduler() = default;
+  size_t size() const { return bits; }
 
-  template<typename Fnc, typename... Args>
-  size_t add(Fnc&& f, Args&&... args) {
-    static_assert(sizeof...(Args) <= 2, "Максимум 2 аргумента поддерживается");
+  void resize(size_t n) {
+    words.resize((n + 63) / 64, 0);
+    bits = n;
+  }
 
-    using DecayedTuple = std::tuple<typename unwrap_future<std::decay_t<Args>>::type...>;
-    auto inputs = std::make_shared<std::tuple<InputDesc<typename unwrap_future<std::decay_t<Args>>::type>...>>(
-      InputDesc<typename unwrap_future<std::decay_t<Args>>::type>(std::forward<Args>(args))...);
+  bool test(size_t i) const { return i < bits && ((words[i >> 6] >> (i & 63)) & 1u); }
+  void set(size_t i) { words[i >> 6] |= uint64_t(1) << (i & 63); }
+  void reset(size_t i) { words[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
 
-    auto exec = [f = std::forward<Fnc>(f), inputs](TTaskScheduler& sched) -> AnyValue {
-      return TTaskScheduler::invoke_callable(f, inputs, sched);
-    };
+  /// Сбрасывает все биты (memset по словам).
+  void clear() { std::fill(words.begin(), words.end(), uint64_t(0)); }
 
-    tasks.emplace_back();
-    tasks.back().executor = std::move(exec);
-    visiting.resize(tasks.size(), false);
-    return tasks.size() - 1;
+  size_t count() const {
+    size_t c = 0;
+    for (uint64_t w : words) c += static_cast<size_t>(__builtin_popcountll(w));
+    return c;
   }
 
-  template<typename T>
-  FutureResult<T> getFutureResult(size_t id) const { return FutureResult<T>(id); }
+  /// Первый установленный бит с индексом >= from либо size(), если такого нет.
+  size_t findNextSet(size_t from) const { return findNext(from, 0); }
 
-  template<typename T>
-  T getResult(size_t id) {
-    if (id >= tasks.size()) throw std::out_of_range("Task id out of range");
-    if (visiting.size() != tasks.size()) visiting.resize(tasks.size(), false);
-    AnyValue av = computeInternal(id);
-    T* p = av.try_cast<T>();
-    if (!p) throw std::runtime_error("Bad result type requested in getResult");
-    return *p;
+  /// Первый сброшенный бит с индексом >= from либо size(), если такого нет.
+  size_t findNextUnset(size_t from) const { return findNext(from, ~uint64_t(0)); }
+
+private:
+  std::vector<uint64_t> words;
+  size_t bits = 0;
+
+  // flip == 0 ищет единицы, flip == ~0 ищет нули.
+  size_t findNext(size_t from, uint64_t flip) const {
+    if (from >= bits) return bits;
+    size_t w = from >> 6;
+    uint64_t cur = (words[w] ^ flip) & (~uint64_t(0) << (from & 63));
+    while (cur == 0) {
+      w = skipWords(w + 1, flip);
+      if (w >= words.size()) return bits;
+      cur = words[w] ^ flip;
+    }
+    return std::min(bits, (w << 6) + static_cast<size_t>(__builtin_ctzll(cur)));
   }
 
-  void executeAll() {
-    visiting.assign(tasks.size(), false);
-    for (size_t i = 0; i < tasks.size(); ++i) {
-      if (!tasks[i].evaluated) computeInternal(i);
+  // Первое слово с индексом >= w, отличное от flip.
+  size_t skipWords(size_t w, uint64_t flip) const {
+    const size_t n = words.size();
+#if defined(__AVX2__)
+    const __m256i fill = _mm256_set1_epi64x(static_cast<long long>(flip));
+    for (; w + 4 <= n; w += 4) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words.data() + w));
+      __m256i diff = _mm256_xor_si256(v, fill);
+      if (!_mm256_testz_si256(diff, diff)) break;
     }
+#endif
+    while (w < n && words[w] == flip) ++w;
+    return w;
   }
+};
 
-  size_t size() const { return tasks.size(); }
+/**
+ * @class SegmentedArray
+ * @brief Массив только на добавление со стабильными адресами элементов.
+ *
+ * Элементы лежат в сегментах растущего размера: каждый диапазон индексов
+ * [2^e, 2^(e+1)) (со сдвигом на 1024) делится на 8 равных сегментов, как корзины
+ * LatencyHistogram. Сегмент конструирует все свои элементы сразу, поэтому
+ * выделено и занято не больше 1/8 сверх нужного — при удвоении сегментов
+ * граф из 10M задач держал бы ~6.7M пустых Task. Сегмент
+ * выделяется при первом обращении к любому его индексу — кто первым успел CAS,
+ * тот и публикует, проигравший освобождает свою копию. Уже выделенные сегменты
+ * никогда не перемещаются, поэтому ссылки на элементы остаются валидными, пока
+ * другие потоки расширяют массив. Массив с заранее известной длиной меньше
+ * первого сегмента (экземпляр Subgraph) выделяет первый сегмент ровно под неё.
+ */
+template<typename T>
+class SegmentedArray {
+public:
+  static constexpr size_t kFirstBits = 10;
+  static constexpr size_t kSubBits = 3;
+  static constexpr size_t kMaxBits = 48;
+  static constexpr size_t kSegments = (kMaxBits - kFirstBits) << kSubBits;
+  /// Индексы [0, kCapacity) покрыты сегментами; больший индекс — ошибка вызывающего.
+  static constexpr size_t kCapacity = (size_t(1) << kMaxBits) - (size_t(1) << kFirstBits);
 
-private:
-  template<typename T>
-  struct InputDesc {
-    bool isDep;
-    size_t depId;
-    T value;
+  SegmentedArray() {
+    for (auto& seg : segments) seg.store(nullptr, std::memory_order_relaxed);
+  }
 
-    InputDesc(T&& v) : isDep(false), depId(static_cast<size_t>(-1)), value(std::forward<T>(v)) {}
-    InputDesc(const T& v) : isDep(false), depId(static_cast<size_t>(-1)), value(v) {}
-    InputDesc(FutureResult<T> f) : isDep(true), depId(f.id), value() {}
+  /// Массив не длиннее n элементов; при n меньше первого сегмента тот выделяется сразу на n.
+  explicit SegmentedArray(size_t n) : SegmentedArray() {
+    if (n == 0 || n >= segmentSize(0)) return;
+    segments[0].store(new T[n], std::memory_order_relaxed);
+    limit = n;
+  }
 
-    T get(TTaskScheduler& s) const {
-      if (!isDep) return value;
-      return s.template getResult<T>(depId);
-    }
-  };
+  ~SegmentedArray() {
+    for (auto& seg : segments) delete[] seg.load(std::memory_order_relaxed);
+  }
 
-  struct Task {
-    std::function<AnyValue(TTaskScheduler&)> executor;
-    AnyValue result;
-    bool evaluated = false;
-  };
+  SegmentedArray(const SegmentedArray&) = delete;
+  SegmentedArray& operator=(const SegmentedArray&) = delete;
 
-  std::vector<Task> tasks;
-  std::vector<bool> visiting;
+  /// Элемент i; его сегмент должен быть уже выделен (см. ensure).
+  T& operator[](size_t i) const {
+    assert(i < limit && "SegmentedArray index beyond its fixed length");
+    auto [k, offset] = locate(i);
+    return segments[k].load(std::memory_order_acquire)[offset];
+  }
 
-  AnyValue computeInternal(size_t id) {
-    if (id >= tasks.size()) throw std::out_of_range("Task id out of range");
-    if (tasks[id].evaluated) return tasks[id].result;
-    if (visiting[id]) throw std::runtime_error("Cyclic dependency detected");
-    visiting[id] = true;
+  /// Элемент i или nullptr, если его сегмент ещё не выделен; можно звать из любого потока.
+  T* find(size_t i) const {
+    if (i >= limit) return nullptr;
+    auto [k, offset] = locate(i);
+    T* seg = segments[k].load(std::memory_order_acquire);
+    return seg ? seg + offset : nullptr;
+  }
 
-    if (!tasks[id].executor) {
-      visiting[id] = false;
-      throw std::runtime_error("Task has no executor");
+  /// Элемент i с выделением сегмента при необходимости.
+  T& ensure(size_t i) {
+    assert(i < limit && "SegmentedArray index beyond its fixed length");
+    auto [k, offset] = locate(i);
+    T* seg = segments[k].load(std::memory_order_acquire);
+    if (!seg) {
+      T* fresh = new T[segmentSize(k)];
+      if (segments[k].compare_exchange_strong(seg, fresh, std::memory_order_acq_rel)) {
+        seg = fresh;
+      } else {
+        delete[] fresh;
+      }
     }
+    return seg[offset];
+  }
+
+private:
+  mutable std::array<std::atomic<T*>, kSegments> segments;
+  size_t limit = kCapacity;  ///< первый сегмент укорочен до limit элементов, если limit < kCapacity
+
+  static size_t segmentSize(size_t k) { return size_t(1) << ((k >> kSubBits) + kFirstBits - kSubBits); }
 
-    AnyValue res = tasks[id].executor(*this);
-    tasks[id].result = std::move(res);
-    tasks[id].evaluated = true;
-    visiting[id] = false;
-    return tasks[id].result;
+  static std::pair<size_t, size_t> locate(size_t i) {
+    assert(i < kCapacity && "SegmentedArray index out of range");
+    const size_t x = i + (size_t(1) << kFirstBits);
+    const size_t e = static_cast<size_t>(std::bit_width(x)) - 1;
+    const size_t shift = e - kSubBits;
+    const size_t k = ((e - kFirstBits) << kSubBits) + ((x >> shift) & ((size_t(1) << kSubBits) - 1));
+    // i < kCapacity гарантирует k < kSegments; min лишь доказывает это компилятору
+    // (иначе -Wstringop-overflow на segments[k] в каждом встроенном add()).
+    return {std::min(k, kSegments - 1), x & ((size_t(1) << shift) - 1)};
   }
+};
 
-  template<typename Fnc, typename TuplePtr>
-  static AnyValue invoke_callable(Fnc f, TuplePtr inputs_ptr, TTaskScheduler& sched) {
-    constexpr size_t N = std::tuple_size<typename std::remove_reference<decltype(*inputs_ptr)>::type>::value;
-    return invoke_impl(f, inputs_ptr, sched, std::integral_constant<size_t, N>{});
+/**
+ * @class ThreadPool
+ * @brief Минимальный пул потоков с общей FIFO-очередью заданий.
+ *
+ * Используется TTaskScheduler в параллельном режиме. Задания не должны бросать
+ * исключения — шедулер сам перехватывает их и передаёт вызывающему потоку.
+ * Фоновые задания (submitIdle) берутся, только когда обычная очередь пуста.
+ * submitTo закрепляет задание за конкретным потоком (детерминированное
+ * расписание): у каждого потока своя очередь, которую он проверяет первой.
+ * Свободный поток спит на своём семафоре и записан в список свободных;
+ * submit будит одного из них, submitTo — именно нужный.
+ * Поток пула, который сам ждёт заданий этого же пула (вложенный подграф),
+ * не блокируется, а выполняет чужие задания через runPending.
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t threads) : slots(threads) {
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) workers.emplace_back([this, i] { workerLoop(i); });
   }
 
-  template<typename Fnc, typename TuplePtr>
-  static AnyValue invoke_impl(Fnc& f, TuplePtr, TTaskScheduler&, std::integral_constant<size_t, 0>) {
-    using R = std::invoke_result_t<Fnc>;
-    if constexpr (std::is_void<R>::value) {
-      std::invoke(f);
-      return AnyValue();
-    } else {
-      R r = std::invoke(f);
-      return AnyValue(std::move(r));
+  ~ThreadPool() {
+    std::vector<size_t> wake;
+    {
+      std::lock_guard<std::mutex> lk(m);
+      stopping = true;
+      wake.swap(idle);
     }
+    for (size_t i : wake) slots[i].wake.release();
+    for (auto& w : workers) w.join();
   }
 
-  template<typename Fnc, typename TuplePtr>
-  static AnyValue invoke_impl(Fnc& f, TuplePtr inputs_ptr, TTaskScheduler& sched, std::integral_constant<size_t, 1>) {
-    auto& tpl = *inputs_ptr;
-    auto& a0 = std::get<0>(tpl);
-    using V0 = decltype(a0.get(sched));
-    V0 v0 = a0.get(sched);
-    using R = std::invoke_result_t<Fnc, V0>;
-    if constexpr (std::is_void<R>::value) {
-      std::invoke(f, std::move(v0));
-      return AnyValue();
-    } else {
-      R r = std::invoke(f, std::move(v0));
-      return AnyValue(std::move(r));
-    }
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(std::function<void()> job) {
+    std::unique_lock<std::mutex> lk(m);
+    jobs.push_back(std::move(job));
+    queued.store(jobs.size(), std::memory_order_relaxed);
+    wakeAny(lk);
   }
 
-  template<typename Fnc, typename TuplePtr>
-  static AnyValue invoke_impl(Fnc& f, TuplePtr inputs_ptr, TTaskScheduler& sched, std::integral_constant<size_t, 2>) {
-    auto& tpl = *inputs_ptr;
-    auto& a0 = std::get<0>(tpl);
-    auto& a1 = std::get<1>(tpl);
-    using V0 = decltype(a0.get(sched));
-    using V1 = decltype(a1.get(sched));
-    V0 v0 = a0.get(sched);
-    V1 v1 = a1.get(sched);
-    using R = std::invoke_result_t<Fnc, V0, V1>;
-    if constexpr (std::is_void<R>::value) {
-      std::invoke(f, std::move(v0), std::move(v1));
-      return AnyValue();
-    } else {
-      R r = std::invoke(f, std::move(v0), std::move(v1));
-      return AnyValue(std::move(r));
-    }
+  void submitIdle(std::function<void()> job) {
+    std::unique_lock<std::mutex> lk(m);
+    idleJobs.push_back(std::move(job));
+    wakeAny(lk);
+  }
+
+  /// Задание, которое выполнит только поток worker (0 <= worker < size()).
+  void submitTo(size_t worker, std::function<void()> job) {
+    std::unique_lock<std::mutex> lk(m);
+    slots[worker].pinned.push_back(std::move(job));
+    auto it = std::find(idle.begin(), idle.end(), worker);
+    if (it == idle.end()) return;  // занят — увидит задание, когда освободится
+    idle.erase(it);
+    lk.unlock();
+    slots[worker].wake.release();
+  }
+
+  size_t size() const { return workers.size(); }
+
+  /// Обычные задания, ждущие свободного потока; читается без блокировки.
+  size_t queueDepth() const { return queued.load(std::memory_order_relaxed); }
+
+  /// Номер потока пула, из которого идёт вызов; size_t(-1) вне пула.
+  static size_t currentWorker() { return workerIndex(); }
+
+  /// Пул, которому принадлежит вызывающий поток; nullptr вне пулов.
+  static ThreadPool* current() { return currentPool(); }
+
+  /**
+   * @brief Выполняет одно ждущее задание в вызывающем потоке пула (свою
+   * закреплённую очередь, затем общую); false, если выполнять нечего.
+   */
+  bool runPending() {
+    std::unique_lock<std::mutex> lk(m);
+    auto& own = slots[workerIndex()].pinned;
+    auto& queue = !own.empty() ? own : jobs;
+    if (queue.empty()) return false;
+    std::function<void()> job = std::move(queue.front());
+    queue.pop_front();
+    queued.store(jobs.size(), std::memory_order_relaxed);
+    lk.unlock();
+    job();
+    return true;
   }
+
+private:
+  struct Slot {
+    std::deque<std::function<void()>> pinned;
+    std::binary_semaphore wake{0};
+  };
+
+  std::vector<std::thread> workers;
+  std::vector<Slot> slots;
+  std::deque<std::function<void()>> jobs;
+  std::deque<std::function<void()>> idleJobs;
+  std::vector<size_t> idle;  ///< спящие потоки; кто будит, тот и вычёркивает
+  std::mutex m;
+  std::atomic<size_t> queued{0};
+  bool stopping = false;
+
+  static size_t& workerIndex() {
+    static thread_local size_t index = size_t(-1);
+    return index;
+  }
+
+  static ThreadPool*& currentPool() {
+    static thread_local ThreadPool* owner = nullptr;
+    return owner;
+  }
+
+  void wakeAny(std::unique_lock<std::mutex>& lk) {
+    if (idle.empty()) return;  // все заняты — задание возьмёт первый освободившийся
+    const size_t w = idle.back();
+    idle.pop_back();
+    lk.unlock();
+    slots[w].wake.release();
+  }
+
+  void workerLoop(size_t self) {
+    workerIndex() = self;
+    currentPool() = this;
+    std::unique_lock<std::mutex> lk(m);
+    for (;;) {
+      auto& own = slots[self].pinned;
+      auto& queue = !own.empty() ? own : !jobs.empty() ? jobs : idleJobs;
+      if (queue.empty()) {
+        if (stopping) return;
+        idle.push_back(self);
+        lk.unlock();
+        slots[self].wake.acquire();
+        lk.lock();
+        continue;
+      }
+      std::function<void()> job = std::move(queue.front());
+      queue.pop_front();
+      queued.store(jobs.size(), std::memory_order_relaxed);
+      lk.unlock();
+      job();
+      lk.lock();
+    }
+  }
+};
+
+/**
+ * @class CostModel
+ * @brief Статистика стоимости задач по видам: время выполнения и размер результата.
+ *
+ * Вид задачи — устойчивое имя: по умолчанию имя типа callable (typeid), либо
+ * заданное TTaskScheduler::setKind. Для каждого вида хранятся суммы и
+ * гистограммы по степеням двойки для времени (нс) и размера результата
+ * (байты, оценка AnyValue::bytes). save/load переносят модель между запусками
+ * процесса через небольшой текстовый файл. Старые наблюдения постепенно
+ * забываются: когда у вида набирается kHalfLife наблюдений, его счётчики
+ * делятся пополам.
+ */
+class CostModel {
+public:
+  static constexpr uint64_t kHalfLife = uint64_t(1) << 16;
+  static constexpr size_t kBuckets = 64;
+
+  struct KindStats {
+    uint64_t count = 0;
+    double meanNs = 0;
+    double meanBytes = 0;
+    uint64_t p50Ns = 0;  ///< верхняя граница корзины гистограммы
+    uint64_t p99Ns = 0;
+  };
+
+  /// Номер вида по имени; таблица имён общая для всего процесса.
+  static uint32_t kindOf(std::string_view name) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.m);
+    auto it = r.ids.find(std::string(name));
+    if (it != r.ids.end()) return it->second;
+    const auto id = static_cast<uint32_t>(r.names.size());
+    r.names.emplace_back(name);
+    r.ids.emplace(r.names.back(), id);
+    return id;
+  }
+
+  static std::string kindName(uint32_t kind) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.m);
+    return kind < r.names.size() ? r.names[kind] : std::string();
+  }
+
+  void record(uint32_t kind, uint64_t ns, size_t bytes) {
+    if (kind >= entries.size()) entries.resize(kind + 1);
+    Entry& e = entries[kind];
+    if (e.count >= kHalfLife) e.halve();
+    ++e.count;
+    e.sumNs += ns;
+    e.sumBytes += bytes;
+    ++e.timeHist[bucket(ns)];
+    ++e.bytesHist[bucket(bytes)];
+  }
+
+  bool known(uint32_t kind) const { return kind < entries.size() && entries[kind].count > 0; }
+
+  /// Есть ли хоть одно наблюдение.
+  bool empty() const {
+    return std::none_of(entries.begin(), entries.end(), [](const Entry& e) { return e.count > 0; });
+  }
+
+  /// Среднее время выполнения вида; 0 для неизвестного.
+  double estimateNs(uint32_t kind) const {
+    return known(kind) ? static_cast<double>(entries[kind].sumNs) / static_cast<double>(entries[kind].count) : 0.0;
+  }
+
+  /// Средний размер результата вида; 0 для неизвестного.
+  double estimateBytes(uint32_t kind) const {
+    return known(kind) ? static_cast<double>(entries[kind].sumBytes) / static_cast<double>(entries[kind].count) : 0.0;
+  }
+
+  KindStats stats(std::string_view name) const {
+    KindStats out;
+    const uint32_t kind = kindOf(name);
+    if (!known(kind)) return out;
+    const Entry& e = entries[kind];
+    out.count = e.count;
+    out.meanNs = estimateNs(kind);
+    out.meanBytes = estimateBytes(kind);
+    out.p50Ns = quantile(e.timeHist, e.count, 0.5);
+    out.p99Ns = quantile(e.timeHist, e.count, 0.99);
+    return out;
+  }
+
+  /**
+   * @brief Записывает модель в файл: строка на вид, поля через табуляцию —
+   * имя, число наблюдений, суммы времени и байт, затем ненулевые корзины
+   * гистограмм времени и размера в виде «корзина:счётчик».
+   * @throws std::runtime_error, если файл не удалось записать.
+   */
+  void save(const std::string& path) const {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) throw std::runtime_error("Cannot write cost model to " + path);
+    out << "# task scheduler cost model v1\n";
+    for (uint32_t k = 0; k < entries.size(); ++k) {
+      const Entry& e = entries[k];
+      if (e.count == 0) continue;
+      out << kindName(k) << '\t' << e.count << '\t' << e.sumNs << '\t' << e.sumBytes << '\t';
+      writeHist(out, e.timeHist);
+      out << '\t';
+      writeHist(out, e.bytesHist);
+      out << '\n';
+    }
+    if (!out) throw std::runtime_error("Cannot write cost model to " + path);
+  }
+
+  /**
+   * @brief Добавляет к модели наблюдения из файла, записанного save().
+   * @return false, если файла нет (первый запуск).
+   * @throws std::runtime_error при повреждённом файле.
+   */
+  bool load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#') continue;
+      std::istringstream fields(line);
+      std::string name, timeHist, bytesHist;
+      Entry loaded;
+      if (!std::getline(fields, name, '\t') || !(fields >> loaded.count >> loaded.sumNs >> loaded.sumBytes)) {
+        throw std::runtime_error("Malformed cost model line: " + line);
+      }
+      fields.ignore(1, '\t');
+      std::getline(fields, timeHist, '\t');
+      std::getline(fields, bytesHist);
+      readHist(timeHist, loaded.timeHist);
+      readHist(bytesHist, loaded.bytesHist);
+
+      const uint32_t kind = kindOf(name);
+      if (kind >= entries.size()) entries.resize(kind + 1);
+      entries[kind].merge(loaded);
+    }
+    return true;
+  }
+
+private:
+  struct Entry {
+    uint64_t count = 0;
+    uint64_t sumNs = 0;
+    uint64_t sumBytes = 0;
+    std::array<uint64_t, kBuckets> timeHist{};
+    std::array<uint64_t, kBuckets> bytesHist{};
+
+    void halve() {
+      count /= 2;
+      sumNs /= 2;
+      sumBytes /= 2;
+      for (auto& c : timeHist) c /= 2;
+      for (auto& c : bytesHist) c /= 2;
+    }
+
+    void merge(const Entry& o) {
+      count += o.count;
+      sumNs += o.sumNs;
+      sumBytes += o.sumBytes;
+      for (size_t i = 0; i < kBuckets; ++i) {
+        timeHist[i] += o.timeHist[i];
+        bytesHist[i] += o.bytesHist[i];
+      }
+      while (count > kHalfLife) halve();
+    }
+  };
+
+  struct Registry {
+    std::mutex m;
+    std::deque<std::string> names;
+    std::unordered_map<std::string, uint32_t> ids;
+  };
+
+  std::vector<Entry> entries;  ///< по номеру вида
+
+  static Registry& registry() {
+    static Registry r;
+    return r;
+  }
+
+  static size_t bucket(uint64_t x) { return x ? static_cast<size_t>(std::bit_width(x)) - 1 : 0; }
+
+  static uint64_t quantile(const std::array<uint64_t, kBuckets>& hist, uint64_t count, double q) {
+    const auto target = static_cast<uint64_t>(std::ceil(q * static_cast<double>(count)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      seen += hist[i];
+      if (seen >= target && seen > 0) return i + 1 < kBuckets ? (uint64_t(1) << (i + 1)) - 1 : ~uint64_t(0);
+    }
+    return 0;
+  }
+
+  static void writeHist(std::ostream& out, const std::array<uint64_t, kBuckets>& hist) {
+    bool first = true;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      if (!hist[i]) continue;
+      out << (first ? "" : " ") << i << ':' << hist[i];
+      first = false;
+    }
+  }
+
+  static void readHist(const std::string& text, std::array<uint64_t, kBuckets>& hist) {
+    std::istringstream in(text);
+    size_t i;
+    char colon;
+    uint64_t c;
+    while (in >> i >> colon >> c) {
+      if (colon != ':' || i >= kBuckets) throw std::runtime_error("Malformed cost model histogram: " + text);
+      hist[i] = c;
+    }
+  }
+};
+
+/**
+ * @class LatencyHistogram
+ * @brief Гистограмма задержек в духе HDR: логарифмические корзины с 8 линейными
+ * подкорзинами на каждую степень двойки (относительная ошибка до 12.5%).
+ *
+ * Значения — наносекунды от 0 до 2^64. Запись — один инкремент счётчика,
+ * слияние гистограмм (например, собранных разными потоками или шедулерами) —
+ * поэлементное сложение массивов.
+ */
+class LatencyHistogram {
+public:
+  static constexpr unsigned kSubBits = 3;
+  static constexpr size_t kSub = size_t(1) << kSubBits;
+  static constexpr size_t kBuckets = (64 - kSubBits) * kSub + kSub;
+
+  struct Summary {
+    uint64_t count = 0;
+    uint64_t p50 = 0;  ///< верхние границы корзин, нс
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+    uint64_t max = 0;
+  };
+
+  void record(uint64_t ns) {
+    ++counts[index(ns)];
+    ++total;
+    sumValue += ns;
+    maxValue = std::max(maxValue, ns);
+  }
+
+  void merge(const LatencyHistogram& o) {
+    for (size_t i = 0; i < kBuckets; ++i) counts[i] += o.counts[i];
+    total += o.total;
+    sumValue += o.sumValue;
+    maxValue = std::max(maxValue, o.maxValue);
+  }
+
+  uint64_t count() const { return total; }
+
+  /// Сумма записанных значений, нс.
+  uint64_t sum() const { return sumValue; }
+
+  /// Верхняя граница корзины, в которую попадает квантиль q (0 < q <= 1).
+  uint64_t quantile(double q) const {
+    if (total == 0) return 0;
+    const auto target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(total))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      seen += counts[i];
+      if (seen >= target) return std::min(upperBound(i), maxValue);
+    }
+    return maxValue;
+  }
+
+  Summary summary() const { return {total, quantile(0.5), quantile(0.99), quantile(0.999), maxValue}; }
+
+  static size_t index(uint64_t v) {
+    if (v < 2 * kSub) return static_cast<size_t>(v);
+    const unsigned e = static_cast<unsigned>(std::bit_width(v)) - 1;
+    return (e - kSubBits) * kSub + static_cast<size_t>(v >> (e - kSubBits));
+  }
+
+  static uint64_t upperBound(size_t i) {
+    if (i < 2 * kSub) return i;
+    const unsigned e = static_cast<unsigned>(i / kSub) + kSubBits - 1;
+    const uint64_t m = i % kSub + kSub;
+    const uint64_t next = (m + 1) << (e - kSubBits);
+    return next == 0 ? ~uint64_t(0) : next - 1;
+  }
+
+private:
+  std::array<uint64_t, kBuckets> counts{};
+  uint64_t total = 0;
+  uint64_t sumValue = 0;
+  uint64_t maxValue = 0;
+};
+
+/**
+ * @class AllocationCounter
+ * @brief Счётчики выделений памяти текущего потока — для атрибуции выделений задачам.
+ *
+ * Сам по себе operator new счётчики не трогает: в одной единице трансляции
+ * программы нужно раскрыть TASK_SCHEDULER_COUNT_ALLOCATIONS() или, если
+ * operator new уже заменён, вызывать из него AllocationCounter::note(size).
+ * Шедулер с setAllocationTracking(true) берёт разность счётчиков вокруг вызова
+ * каждой задачи — на том потоке, где она выполняется.
+ */
+class AllocationCounter {
+public:
+  struct Counts {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+
+    Counts operator-(const Counts& o) const { return {allocations - o.allocations, bytes - o.bytes}; }
+    Counts& operator+=(const Counts& o) {
+      allocations += o.allocations;
+      bytes += o.bytes;
+      return *this;
+    }
+  };
+
+  /// Учитывает выделение size байт текущим потоком; вызывается из operator new.
+  static void note(size_t size) noexcept {
+    Counts& c = local();
+    ++c.allocations;
+    c.bytes += size;
+  }
+
+  static Counts current() noexcept { return local(); }
+
+  /**
+   * @brief Выделение для заменённого operator new: note(size) и malloc
+   * (aligned_alloc, если align != 0). При нехватке памяти бросает bad_alloc,
+   * а если throws == false — возвращает nullptr.
+   */
+  static void* allocate(size_t size, size_t align, bool throws) {
+    note(size);
+    const size_t n = size ? size : 1;
+    void* p = align ? std::aligned_alloc(align, (n + align - 1) / align * align) : std::malloc(n);
+    if (!p && throws) throw std::bad_alloc();
+    return p;
+  }
+
+  /// Заменён ли operator new так, что выделения видны счётчику.
+  static bool hooked() {
+    const uint64_t before = local().allocations;
+    ::operator delete(::operator new(1));  // прямой вызов, компилятор его не выбрасывает
+    return local().allocations != before;
+  }
+
+private:
+  static Counts& local() noexcept {
+    static thread_local Counts counts;  // константная инициализация: без выделений и guard
+    return counts;
+  }
+};
+
+/**
+ * @brief Определяет замену всех форм глобальных operator new/delete поверх
+ * malloc/free, сообщающую о выделениях AllocationCounter. Раскрывать один раз
+ * на программу, в глобальном пространстве имён. Заменяются все формы сразу:
+ * иначе незаменённая (например, sized delete из санитайзера) получит чужой указатель.
+ */
+#define TASK_SCHEDULER_COUNT_ALLOCATIONS()                                                        \
+  void* operator new(std::size_t n) { return AllocationCounter::allocate(n, 0, true); }          \
+  void* operator new[](std::size_t n) { return AllocationCounter::allocate(n, 0, true); }        \
+  void* operator new(std::size_t n, const std::nothrow_t&) noexcept {                             \
+    return AllocationCounter::allocate(n, 0, false);                                              \
+  }                                                                                               \
+  void* operator new[](std::size_t n, const std::nothrow_t&) noexcept {                           \
+    return AllocationCounter::allocate(n, 0, false);                                              \
+  }                                                                                               \
+  void* operator new(std::size_t n, std::align_val_t a) {                                         \
+    return AllocationCounter::allocate(n, static_cast<std::size_t>(a), true);                     \
+  }                                                                                               \
+  void* operator new[](std::size_t n, std::align_val_t a) {                                       \
+    return AllocationCounter::allocate(n, static_cast<std::size_t>(a), true);                     \
+  }                                                                                               \
+  void* operator new(std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept {         \
+    return AllocationCounter::allocate(n, static_cast<std::size_t>(a), false);                    \
+  }                                                                                               \
+  void* operator new[](std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept {       \
+    return AllocationCounter::allocate(n, static_cast<std::size_t>(a), false);                    \
+  }                                                                                               \
+  void operator delete(void* p) noexcept { std::free(p); }                                        \
+  void operator delete[](void* p) noexcept { std::free(p); }                                      \
+  void operator delete(void* p, std::size_t) noexcept { std::free(p); }                           \
+  void operator delete[](void* p, std::size_t) noexcept { std::free(p); }                         \
+  void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }                 \
+  void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }               \
+  void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }                      \
+  void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }                    \
+  void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }         \
+  void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }       \
+  void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); } \
+  void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+template<typename Signature>
+class Subgraph;
+
+template<typename S>
+class FixedPoint;
+
+/**
+ * @class TTaskScheduler
+ * @brief Шедулер задач с поддержкой зависимостей по результатам других задач.
+ *
+ * TTaskScheduler позволяет добавлять задачи — любые callable-объекты (функции, лямбды,
+ * указатели на методы классов). Каждая задача может принимать не более двух аргументов.
+ * Аргументы могут быть обычными значениями (они копируются/перемещаются при добавлении)
+ * либо специальными объектами FutureResult<T>, которые указывают на результат другой задачи
+ * (идентифицируемой по id). Большие неизменяемые значения, нужные многим задачам, передаются
+ * через share(x) (один общий экземпляр) или borrow(x) (ссылка на значение вызывающего кода). Когда задача добавлена, она не выполняется сразу — выполнение
+ * происходит лениво при вызове getResult<T>(id) или принудительно методом executeAll().
+ *
+ * Особенности:
+ *  - Результаты хранятся в обёртке AnyValue (type-erasure).
+ *  - При попытке получить результат с неверным типом будет выброшено std::runtime_error.
+ *  - При наличии циклических зависимостей вычисление приводит к std::runtime_error.
+ *  - Зависимости хранятся явно: у каждой задачи есть список входов (deps), список
+ *    потребителей (consumers) и атомарный счётчик ещё не вычисленных входов (pending).
+ *    Завершение задачи уменьшает счётчики потребителей, а достигшие нуля попадают в
+ *    очередь готовых задач — executeAll() выполняет граф по алгоритму Кана за O(V+E).
+ *  - В параллельном режиме (конструктор с числом потоков) getResult() находит конус
+ *    зависимостей цели и выполняет его независимые ветви одновременно на пуле потоков;
+ *    задачи вне конуса по-прежнему не выполняются.
+ *  - add() можно вызывать одновременно из любого числа потоков, в том числе пока
+ *    другой поток вычисляет граф: задачи лежат в SegmentedArray со стабильными
+ *    адресами, id выдаётся атомарным fetch_add, а рёбра регистрируются без блокировок.
+ *    Методы вычисления (getResult, getResults, executeAll) в каждый момент должен
+ *    вызывать только один поток.
+ *  - Опционально (enableSpeculation) свободные потоки пула заранее вычисляют
+ *    задачи, помеченные чистыми (markPure), из конусов объявленных выходов
+ *    (declareOutput). Остальные задачи по-прежнему выполняются только по запросу.
+ *  - С learnCosts() шедулер измеряет время и размер результата каждой задачи и
+ *    копит их в CostModel по видам задач. Модель (её можно сохранить и загрузить)
+ *    задаёт приоритет критического пути в параллельном getResult, выполнение
+ *    мелких задач прямо в координаторе и политику пересчёта результатов.
+ *  - setLatencySampling(N) включает гистограммы задержек по видам задач (каждая
+ *    N-я задача или запрос): время выполнения, ожидание в очереди пула и полное
+ *    время getResult.
+ *  - setAllocationTracking() считает выделения памяти внутри задач (см.
+ *    AllocationCounter) в stats() и по видам задач.
+ */
+class TTaskScheduler {
+public:
+  TTaskScheduler() = default;
+
+  /**
+   * @brief Создаёт шедулер с пулом из threads рабочих потоков.
+   * @param threads число потоков; 0 — последовательный режим, как у конструктора по умолчанию.
+   */
+  explicit TTaskScheduler(size_t threads) {
+    if (threads > 0) {
+      ownedPool = std::make_unique<ThreadPool>(threads);
+      pool = ownedPool.get();
+    }
+  }
+
+  ~TTaskScheduler() {
+    speculationOn.store(false, std::memory_order_relaxed);
+    ownedPool.reset();
+    // Экземпляр подграфа отдаёт буферы результатов прототипу — их возьмёт следующий экземпляр.
+    if (recycleTarget != &bufferPool) {
+      for (size_t i = 0, n = size(); i < n; ++i) tasks[i].result.recycleInto(*recycleTarget);
+    }
+  }
+
+  template<typename Fnc, typename... Args>
+  size_t add(Fnc&& f, Args&&... args) {
+    static_assert(sizeof...(Args) <= 2, "Максимум 2 аргумента поддерживается");
+
+    using Inputs = std::tuple<typename input_for<std::decay_t<Args>>::type...>;
+    Inputs inputs(typename input_for<std::decay_t<Args>>::type(std::forward<Args>(args))...);
+
+    if constexpr (sizeof(TaskId) < sizeof(size_t)) {
+      if (size() >= std::numeric_limits<TaskId>::max()) throw std::length_error("Too many tasks for TaskId");
+    }
+    // До выдачи id: отклонённая задача не должна оставить невыданный (неопубликованный) id.
+    const size_t depLimit = std::min(nextId.load() + kForwardWindow, SegmentedArray<Task>::kCapacity - 1);
+    std::apply([depLimit](const auto&... in) { (checkDependency(in.dependency(), depLimit), ...); }, inputs);
+    static const uint32_t defaultKind = CostModel::kindOf(typeid(std::decay_t<Fnc>).name());
+
+    const size_t id = nextId.fetch_add(1);
+    Task& t = tasks.ensure(id);
+    t.id = static_cast<TaskId>(id);
+    t.kind.store(defaultKind, std::memory_order_relaxed);
+    std::apply([&t](const auto&... in) { (in.appendDep(t), ...); }, inputs);
+
+    // Аргументы лежат прямо в замыкании — одно выделение памяти на задачу.
+    // std::function требует копируемости, поэтому некопируемые аргументы
+    // по-прежнему уходят в общий shared_ptr.
+    if constexpr (std::is_copy_constructible_v<Inputs>) {
+      t.executor = [f = std::forward<Fnc>(f), inputs = std::move(inputs)](TTaskScheduler& sched) mutable -> AnyValue {
+        return TTaskScheduler::invoke_callable(f, inputs, sched);
+      };
+    } else {
+      t.executor = [f = std::forward<Fnc>(f), inputs = std::make_shared<Inputs>(std::move(inputs))](TTaskScheduler& sched) mutable -> AnyValue {
+        return TTaskScheduler::invoke_callable(f, *inputs, sched);
+      };
+    }
+    linkTask(t);
+    if (speculationOn.load(std::memory_order_relaxed)) scheduleSpeculation();
+    return id;
+  }
+
+  template<typename T>
+  FutureResult<T> getFutureResult(size_t id) const { return FutureResult<T>(id); }
+
+  template<typename T>
+  T getResult(size_t id) {
+    if (id >= size()) throw std::out_of_range("Task id out of range");
+    const bool timed = sampleEvery.load(std::memory_order_relaxed) != 0;
+    const auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    EvalLock lock(*this);
+    syncStatus();
+    if (!evaluated.test(id)) {
+      const size_t roots[] = {id};
+      runCone(roots, roots + 1);
+    }
+    if (dropped.test(id)) rematerialize(id);
+    T* p = tasks[id].result.template try_cast<T>();
+    if (!p) throw std::runtime_error("Bad result type requested in getResult");
+    if (timed && sampleNext()) latencyOf(tasks[id]).request.record(nanosSince(start));
+    return *p;
+  }
+
+  /**
+   * @brief Пакетный getResult: out[i] = результат задачи ids[i].
+   *
+   * Объединённый конус всех ids находится и выполняется одним проходом (в
+   * параллельном режиме — на пуле), после чего результаты копируются прямо в
+   * out без промежуточных AnyValue. Ошибки сообщаются один раз на весь вызов:
+   * std::invalid_argument при разной длине ids и out, std::out_of_range для
+   * неизвестного id, std::runtime_error при неверном типе (тогда out заполнен
+   * лишь до первого такого id).
+   */
+  template<typename T>
+  void getResults(std::span<const size_t> ids, std::span<T> out) {
+    if (ids.size() != out.size()) throw std::invalid_argument("getResults: ids and out sizes differ");
+    EvalLock lock(*this);
+    syncStatus();
+    for (size_t id : ids) {
+      if (!evaluated.test(id)) {
+        runCone(ids.data(), ids.data() + ids.size());
+        break;
+      }
+    }
+
+    for (size_t i = 0; i < ids.size(); ++i) {
+      if (dropped.test(ids[i])) rematerialize(ids[i]);
+      const T* p = tasks[ids[i]].result.template try_cast<T>();
+      if (!p) throw std::runtime_error("Bad result type requested in getResults");
+      out[i] = *p;
+    }
+  }
+
+  /// Оценка предстоящего getResult, см. explain().
+  struct Explain {
+    size_t unevaluated = 0;     ///< невычисленные задачи конуса — будут выполнены
+    size_t recomputes = 0;      ///< освобождённые результаты, которые придётся пересчитать
+    size_t unestimated = 0;     ///< из них задачи видов, которых модель стоимости не видела
+    double cpuNs = 0;           ///< суммарное оценочное время выполнения
+    double criticalPathNs = 0;  ///< самый дорогой путь — время при неограниченном числе потоков
+    double parallelism = 0;     ///< cpuNs / criticalPathNs
+    size_t peakBytes = 0;       ///< пик памяти под новые результаты при выполнении по порядку
+  };
+
+  /**
+   * @brief Оценивает getResult(id) заранее, ничего не выполняя.
+   *
+   * Обходит невычисленный конус id так же, как getResult (и бросает те же
+   * исключения: неизвестный id, цикл, задача без executor), а стоимость берёт
+   * из модели стоимости (см. learnCosts); виды, которых модель не видела,
+   * оцениваются в kUnknownNs и учитываются в unestimated. Пик памяти
+   * моделируется выполнением конуса по порядку с освобождением пересчитываемых
+   * результатов после их последнего потребителя.
+   */
+  Explain explain(size_t id) {
+    if (id >= size()) throw std::out_of_range("Task id out of range");
+    EvalLock lock(*this);
+    syncStatus();
+    Explain out;
+
+    std::vector<size_t> cone;
+    try {
+      const size_t roots[] = {id};
+      collectCone(roots, roots + 1, cone);
+    } catch (...) {
+      for (size_t v : cone) inCone.reset(v);
+      throw;
+    }
+
+    // Освобождённые входы конуса (и сам id) пересчитываются вместе с их освобождёнными входами.
+    std::vector<size_t> recompute, stack;
+    auto visitDropped = [&](size_t d) {
+      if (!dropped.test(d) || inCone.test(d)) return;
+      inCone.set(d);
+      recompute.push_back(d);
+      stack.push_back(d);
+    };
+    visitDropped(id);
+    for (size_t v : cone) {
+      for (const TaskId d : tasks[v].inputs()) visitDropped(d);
+    }
+    while (!stack.empty()) {
+      const size_t v = stack.back();
+      stack.pop_back();
+      for (const TaskId d : tasks[v].inputs()) visitDropped(d);
+    }
+    for (size_t v : cone) inCone.reset(v);
+    for (size_t v : recompute) inCone.reset(v);
+
+    auto estimateOf = [&](size_t v) {
+      if (!costs.known(tasks[v].kind.load(std::memory_order_relaxed))) ++out.unestimated;
+      return estimateNs(v);
+    };
+    double recomputeNs = 0;
+    for (size_t v : recompute) recomputeNs += estimateOf(v);
+    out.unevaluated = cone.size();
+    out.recomputes = recompute.size();
+
+    auto bytesOf = [&](size_t v) {
+      return static_cast<size_t>(costs.estimateBytes(tasks[v].kind.load(std::memory_order_relaxed)));
+    };
+    std::unordered_map<size_t, uint32_t> usesLeft;  // только для задач конуса
+    for (size_t v : cone) usesLeft.emplace(v, tasks[v].uses.load(std::memory_order_relaxed));
+    size_t live = 0;
+    for (size_t v : cone) {
+      out.cpuNs += estimateOf(v);
+      live += bytesOf(v);
+      out.peakBytes = std::max(out.peakBytes, live);
+      for (const TaskId d : tasks[v].inputs()) {
+        auto it = usesLeft.find(d);
+        if (it == usesLeft.end() || it->second == 0) continue;
+        if (--it->second == 0 && isRematerializable(tasks[d])) live -= std::min(live, bytesOf(d));
+      }
+    }
+
+    if (!cone.empty()) {
+      const auto rank = criticalPathRanks(cone);
+      for (const auto& [v, r] : rank) out.criticalPathNs = std::max(out.criticalPathNs, r);
+    }
+    out.cpuNs += recomputeNs;
+    out.criticalPathNs += recomputeNs;
+    out.parallelism = out.criticalPathNs > 0 ? out.cpuNs / out.criticalPathNs : 0;
+    return out;
+  }
+
+  /**
+   * @brief Выполняет все ещё не вычисленные задачи.
+   *
+   * Задачи берутся из очереди готовых (все входы уже вычислены), поэтому каждая
+   * выполняется ровно один раз без повторных обходов графа. Задачи, так и не ставшие
+   * готовыми (цикл или зависимость на несуществующий id), передаются в runCone,
+   * который и сообщает об ошибке.
+   *
+   * Вызов инкрементален: все задачи с id < executedUpTo уже вычислены, поэтому
+   * повторный вызов после нескольких add() стоит O(новые задачи + их зависимости),
+   * а не O(весь граф).
+   */
+  void executeAll() {
+    EvalLock lock(*this);
+    syncStatus();
+    std::vector<size_t> work;
+    for (Task* t = ready.exchange(nullptr, std::memory_order_acquire); t; t = t->readyNext) {
+      work.push_back(t->id);
+    }
+    // При заданном расписании весь невычисленный граф идёт одним конусом ниже.
+    if (!planned()) runWork(work, true);
+
+    const size_t n = evaluated.size();
+    std::vector<size_t> rest;
+    for (size_t i = evaluated.findNextUnset(executedUpTo); i < n; i = evaluated.findNextUnset(i + 1)) {
+      rest.push_back(i);
+    }
+    if (!rest.empty()) {
+      executedUpTo = rest.front();
+      runCone(rest.data(), rest.data() + rest.size());
+    }
+    executedUpTo = n;
+  }
+
+  /**
+   * @brief Сбрасывает все результаты, чтобы граф можно было прогнать заново.
+   *
+   * Результаты-векторы возвращаются в пул буферов (см. buffers()), счётчики
+   * зависимостей и списки потребителей восстанавливаются по рёбрам задач.
+   * Нельзя вызывать одновременно с add() и вычислением.
+   */
+  void reset() {
+    EvalLock lock(*this);
+    syncStatus();
+    const size_t n = size();
+    ready.store(nullptr, std::memory_order_relaxed);
+    for (size_t i = 0; i < n; ++i) {
+      tasks[i].result.recycleInto(*recycleTarget);
+      tasks[i].held.store(0, std::memory_order_relaxed);
+      tasks[i].consumers.store(nullptr, std::memory_order_relaxed);
+      tasks[i].uses.store(0, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < n; ++i) {
+      Task& t = tasks[i];
+      for (uint8_t k = 0; k < t.depCount; ++k) {
+        tasks.ensure(t.deps[k]).uses.fetch_add(1, std::memory_order_relaxed);
+        // Ребро к так и не добавленной задаче по-прежнему ждёт в forwardConsumers.
+        if (t.deps[k] < n) pushConsumer(tasks[t.deps[k]], t.edges[k]);
+      }
+      t.pending.store(t.depCount, std::memory_order_relaxed);
+      if (t.depCount == 0) pushReady(t);
+    }
+    evaluated.clear();
+    dropped.clear();
+    counters.residentBytes = 0;
+    executedUpTo = 0;
+    reseedSpeculation();
+  }
+
+  /**
+   * @brief Разрешает не хранить результат задачи id, а пересчитывать его.
+   *
+   * Когда все известные потребители задачи выполнились, её результат
+   * освобождается (если суммарный объём хранимых результатов больше бюджета,
+   * см. setMemoryBudget), а позже, если он снова понадобится — getResult или
+   * потребителю, добавленному после, — вычисляется заново вместе с такими же
+   * освобождёнными входами. Потребители при пересчёте повторно не уведомляются.
+   * Подходит для дешёвых, но больших результатов.
+   */
+  void markRematerializable(size_t id) {
+    tasks.ensure(id).rematerializable.store(true, std::memory_order_relaxed);
+    if (!sizeResults) {
+      EvalLock lock(*this);
+      trackResultSizes();
+    }
+  }
+
+  /// Объём хранимых результатов (оценка AnyValue::bytes), ниже которого
+  /// пересчитываемые результаты не освобождаются. По умолчанию 0 — освобождать всегда.
+  void setMemoryBudget(size_t bytes) { memoryBudget = bytes; }
+
+  /// Помечает задачу чистой: без побочных эффектов, её можно выполнить заранее.
+  void markPure(size_t id) {
+    Task& t = tasks.ensure(id);
+    t.pure.store(true, std::memory_order_relaxed);
+    if (!pool || !speculationOn.load(std::memory_order_relaxed)) return;
+    {
+      // Задача уже в обойдённом конусе и готова — иначе её подхватит обход или finishTask.
+      std::lock_guard<std::mutex> lk(evalMutex);
+      if (speculationCone.test(id) && !evaluated.test(id) && t.pending.load(std::memory_order_acquire) == 0) {
+        offerSpeculation(id);
+      }
+    }
+    scheduleSpeculation();
+  }
+
+  /// Объявляет задачу вероятным будущим запросом getResult — её конус
+  /// вычисляется спекулятивно в первую очередь.
+  void declareOutput(size_t id) {
+    {
+      std::lock_guard<std::mutex> lk(evalMutex);
+      declaredOutputs.push_back(id);
+      coneRoots.push_back(id);
+    }
+    scheduleSpeculation();
+  }
+
+  /**
+   * @brief Включает спекулятивное выполнение (только в параллельном режиме).
+   *
+   * Когда обычная очередь пула пуста, один из потоков выполняет чистые задачи
+   * из конусов объявленных выходов, все входы которых уже вычислены, — входы
+   * раньше потребителей, выходы в порядке объявления. Нечистые задачи не
+   * запускаются никогда, поэтому чистая задача с невычисленным нечистым входом
+   * тоже ждёт запроса. Запрос (getResult, getResults, executeAll) имеет
+   * приоритет: спекуляция останавливается перед следующей задачей, и запрос
+   * ждёт не дольше одной уже запущенной. Исключение спекулятивной задачи
+   * проглатывается, а задача остаётся невычисленной до запроса.
+   */
+  void enableSpeculation(bool on = true) {
+    if (on && pool) {
+      // Пока спекуляция была выключена, markPure не предлагал задачи конусов.
+      std::lock_guard<std::mutex> lk(evalMutex);
+      reseedSpeculation();
+    }
+    speculationOn.store(on, std::memory_order_relaxed);
+    scheduleSpeculation();
+  }
+
+  /// Задаёт вид задачи для модели стоимости (по умолчанию — имя типа callable).
+  void setKind(size_t id, std::string_view name) {
+    tasks.ensure(id).kind.store(CostModel::kindOf(name), std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Расписание параллельного вычисления: какие задачи в каком порядке
+   * отданы на выполнение и какой поток их выполнил.
+   */
+  struct Schedule {
+    struct Step {
+      TaskId task;
+      uint32_t worker;  ///< 0 — координатор (вызывающий поток), i > 0 — поток пула i - 1
+      bool operator==(const Step&) const = default;
+    };
+    std::vector<Step> steps;
+
+    /// Сохраняет расписание в текстовый файл; при ошибке записи бросает runtime_error.
+    void save(const std::string& path) const {
+      std::ofstream out(path, std::ios::trunc);
+      if (!out) throw std::runtime_error("Cannot write schedule to " + path);
+      out << "# task scheduler schedule v1\n";
+      for (const Step& st : steps) out << st.task << ' ' << st.worker << '\n';
+      if (!out) throw std::runtime_error("Cannot write schedule to " + path);
+    }
+
+    /// Загружает расписание вместо текущего; false, если файла нет.
+    bool load(const std::string& path) {
+      std::ifstream in(path);
+      if (!in) return false;
+      std::vector<Step> loaded;
+      std::string line;
+      while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        uint64_t task;
+        uint32_t worker;
+        if (!(fields >> task >> worker)) throw std::runtime_error("Malformed schedule line: " + line);
+        loaded.push_back({static_cast<TaskId>(task), worker});
+      }
+      steps.swap(loaded);
+      return true;
+    }
+  };
+
+  /**
+   * @brief Записывать расписание параллельных вычислений (см. recordedSchedule).
+   * Включение очищает прежнюю запись. Без пула все шаги — на координаторе.
+   */
+  void recordSchedule(bool on = true) {
+    std::lock_guard<std::mutex> lk(evalMutex);
+    recording = on;
+    if (on) recorded.steps.clear();
+  }
+
+  Schedule recordedSchedule() const {
+    std::lock_guard<std::mutex> lk(evalMutex);
+    return recorded;
+  }
+
+  /**
+   * @brief Следующие вычисления повторяют записанное расписание: задачи
+   * отдаются в том же порядке тем же потокам (и координатору), независимо от
+   * того, в каком порядке завершаются. Вызовы вычисления должны идти в той же
+   * последовательности, что и при записи. Задачи, которых в расписании нет,
+   * выполняются как обычно и считаются в stats().unplanned.
+   *
+   * Спекуляция при заданном расписании не работает. Без пула вычисление и так
+   * детерминировано, расписание не используется.
+   */
+  void replaySchedule(Schedule schedule) {
+    std::lock_guard<std::mutex> lk(evalMutex);
+    policy = SchedulePolicy::Replay;
+    replay = std::move(schedule);
+    replayCursor = 0;
+  }
+
+  /**
+   * @brief Детерминированная псевдослучайная политика: порядок запуска —
+   * случайный топологический порядок задач вычисления, поток — случайный,
+   * оба от seed. Один seed и одна последовательность вызовов дают одно расписание.
+   */
+  void randomSchedule(uint64_t seed) {
+    std::lock_guard<std::mutex> lk(evalMutex);
+    policy = SchedulePolicy::Seeded;
+    scheduleRng = seed;
+  }
+
+  /// Обычное планирование: готовые задачи раздаются свободным потокам.
+  void dynamicSchedule() {
+    std::lock_guard<std::mutex> lk(evalMutex);
+    policy = SchedulePolicy::Dynamic;
+    replay.steps.clear();
+  }
+
+  /// Включает измерение задач и обучение модели стоимости.
+  void learnCosts(bool on = true) {
+    std::lock_guard<std::mutex> lk(evalMutex);
+    learning = on;
+    if (on) trackResultSizes();
+  }
+
+  /// Модель стоимости шедулера; читать и менять (load/save) между вызовами вычисления.
+  CostModel& costModel() { return costs; }
+
+  /**
+   * @brief Считает пересчитываемыми (см. markRematerializable) задачи видов,
+   * чей результат по модели стоимости в среднем не меньше minBytes, а время
+   * выполнения не больше maxNs. minBytes = 0 отключает политику.
+   */
+  void setRematerializePolicy(size_t minBytes, double maxNs) {
+    std::lock_guard<std::mutex> lk(evalMutex);
+    rematMinBytes = minBytes;
+    rematMaxNs = maxNs;
+    if (minBytes) trackResultSizes();
+  }
+
+  /// Гистограммы задержек одного вида задач.
+  struct KindLatency {
+    LatencyHistogram execution;  ///< выполнение задачи
+    LatencyHistogram queueWait;  ///< от передачи в пул до начала выполнения (только параллельный режим)
+    LatencyHistogram request;    ///< getResult(id) целиком, по виду задачи id
+
+    void merge(const KindLatency& o) {
+      execution.merge(o.execution);
+      queueWait.merge(o.queueWait);
+      request.merge(o.request);
+    }
+  };
+
+  /**
+   * @brief Замер задержек для каждой every-й задачи и каждого every-го getResult;
+   * 0 — выключено (по умолчанию), 1 — замерять всё.
+   */
+  void setLatencySampling(uint32_t every) { sampleEvery.store(every, std::memory_order_relaxed); }
+
+  /// Гистограммы вида name (копия; p50/p99/p999 — через summary()).
+  KindLatency latency(std::string_view name) const {
+    const uint32_t kind = CostModel::kindOf(name);
+    std::lock_guard<std::mutex> lk(evalMutex);
+    return kind < latencies.size() ? latencies[kind] : KindLatency();
+  }
+
+  /// Гистограммы, слитые по всем видам задач.
+  KindLatency latencyTotal() const {
+    std::lock_guard<std::mutex> lk(evalMutex);
+    KindLatency all;
+    for (const auto& l : latencies) all.merge(l);
+    return all;
+  }
+
+  struct Stats {
+    size_t executions = 0;     ///< запуски задач при вычислении графа
+    size_t recomputes = 0;     ///< повторные запуски ради освобождённых результатов
+    size_t dropped = 0;        ///< освобождённые пересчитываемые результаты
+    size_t residentBytes = 0;  ///< оценка памяти хранимых результатов
+    size_t speculated = 0;     ///< задачи, выполненные спекулятивно (входят в executions)
+    uint64_t allocations = 0;     ///< выделения памяти внутри задач (setAllocationTracking)
+    uint64_t allocatedBytes = 0;  ///< их суммарный размер
+    size_t unplanned = 0;         ///< задачи, выполненные вне заданного расписания (replaySchedule)
+  };
+
+  Stats stats() const {
+    std::lock_guard<std::mutex> lk(evalMutex);
+    Stats out = counters;
+    if (!sizeResults) {
+      out.residentBytes = 0;
+      for (size_t i = 0, n = size(); i < n; ++i) {
+        if (const Task* t = tasks.find(i)) out.residentBytes += heldBytes(*t);
+      }
+    }
+    return out;
+  }
+
+  struct FootprintEntry {
+    std::string name;  ///< вид задачи (см. setKind) или тип результата
+    size_t bytes = 0;
+    size_t count = 0;  ///< число хранимых результатов
+  };
+
+  struct Footprint {
+    size_t totalBytes = 0;                          ///< вне вычисления совпадает с stats().residentBytes
+    std::vector<std::pair<size_t, size_t>> tasks;   ///< (id, байты) самых больших результатов
+    std::vector<FootprintEntry> byKind;
+    std::vector<FootprintEntry> byType;
+  };
+
+  /**
+   * @brief Кто держит память: хранимые результаты по задачам, видам и типам.
+   *
+   * Размеры считает result_size — тот же учёт, что у бюджета пересчёта и
+   * модели стоимости. Все списки отсортированы по убыванию байтов; в tasks
+   * попадает не более topTasks задач. Освобождённые результаты не учитываются.
+   */
+  Footprint footprint(size_t topTasks = 16) {
+    EvalLock lock(*this);
+    return scanFootprint(topTasks);
+  }
+
+  struct KindMetrics {
+    std::string name;
+    KindLatency latency;
+    AllocationCounter::Counts allocations;
+  };
+
+  /// Снимок состояния шедулера для внешнего наблюдения (см. metrics()).
+  struct Metrics {
+    uint64_t version = 0;     ///< номер снимка, растёт с каждым новым
+    bool evaluating = false;  ///< снят посреди вычисления
+    size_t tasks = 0;         ///< выданные id
+    size_t queued = 0;        ///< задания в очереди пула
+    size_t inflight = 0;      ///< задачи, отданные в пул и ещё не завершённые
+    Stats stats;
+    std::vector<KindMetrics> kinds;  ///< виды с замерами задержек или выделений
+    Footprint footprint;
+  };
+
+  /**
+   * @brief Разрешает metrics() из других потоков.
+   *
+   * Вызывать до начала наблюдения, пока граф не вычисляется. В
+   * последовательном режиме методы вычисления начинают брать evalMutex
+   * (без пула они обычно обходятся без него).
+   */
+  void enableMetrics(bool on = true) {
+    if (on) {
+      std::lock_guard<std::mutex> lk(evalMutex);
+      trackResultSizes();
+    }
+    metricsOn.store(on, std::memory_order_release);
+  }
+
+  /**
+   * @brief Свежий снимок метрик; можно вызывать из любого потока при enableMetrics().
+   *
+   * Без enableMetrics() состояние вычисления не трогается: возвращается
+   * последний опубликованный снимок (или пустой с version 0) — в
+   * последовательном режиме вычисление тогда идёт без evalMutex.
+   *
+   * Если граф сейчас не вычисляется, счётчики снимаются сразу. Иначе их по
+   * просьбе снимает сам вычисляющий поток между завершениями задач: это
+   * копирование счётчиков и гистограмм по видам, без обхода задач, а горячий
+   * путь платит лишь за чтение одного флага. Если за maxWait снимок не появился
+   * (например, долгая задача в последовательном режиме), возвращается последний
+   * готовый — его version не меняется. footprint снимка вызывающий поток
+   * собирает сам по опубликованным размерам результатов (см. Task::held), не
+   * задерживая вычисление; посреди вычисления он может слегка расходиться со stats.
+   */
+  std::shared_ptr<const Metrics> metrics(std::chrono::milliseconds maxWait = std::chrono::milliseconds(100)) {
+    if (!metricsOn.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lk(metricsMutex);
+      return latestMetrics ? latestMetrics : std::make_shared<const Metrics>();
+    }
+    const uint64_t seen = metricsVersion.load(std::memory_order_acquire);
+    const auto deadline = std::chrono::steady_clock::now() + maxWait;
+    for (bool asked = false;;) {
+      {
+        std::unique_lock<std::mutex> lk(evalMutex, std::try_to_lock);
+        if (lk.owns_lock()) {
+          syncStatus();
+          publishMetrics(false, 0);
+          break;
+        }
+      }
+      if (!asked) {
+        metricsRequested.store(true, std::memory_order_release);
+        asked = true;
+      }
+      if (metricsVersion.load(std::memory_order_acquire) != seen) break;
+      if (std::chrono::steady_clock::now() >= deadline) break;
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    std::shared_ptr<Metrics> out;
+    {
+      std::lock_guard<std::mutex> lk(metricsMutex);
+      out = latestMetrics ? std::make_shared<Metrics>(*latestMetrics) : std::make_shared<Metrics>();
+    }
+    out->footprint = scanFootprint(16);
+    return out;
+  }
+
+private:
+  static constexpr unsigned kHeldTypeBits = 16;
+  /// Результат хранится, но размер не измерен (sizeResults выключен).
+  static constexpr uint64_t kHeldUnsized = uint64_t(1) << kHeldTypeBits;
+  static constexpr unsigned kHeldBytesShift = kHeldTypeBits + 1;
+  static constexpr uint64_t kHeldBytesMax = (uint64_t(1) << (64 - kHeldBytesShift)) - 1;
+
+  // Отчёт footprint по Task::held. При enableMetrics читает только атомики и не
+  // берёт evalMutex, поэтому metrics() зовёт его на своём потоке посреди чужого вычисления.
+  Footprint scanFootprint(size_t topTasks) const {
+    Footprint out;
+    std::unordered_map<uint32_t, FootprintEntry> kinds;
+    std::unordered_map<uint64_t, FootprintEntry> types;
+    const size_t n = size();
+    for (size_t i = 0; i < n; ++i) {
+      const Task* t = tasks.find(i);
+      const uint64_t held = t ? t->held.load(std::memory_order_relaxed) : 0;
+      if (held == 0) continue;
+      const size_t bytes = heldBytes(*t);
+      out.totalBytes += bytes;
+      out.tasks.emplace_back(i, bytes);
+      FootprintEntry& k = kinds[t->kind.load(std::memory_order_relaxed)];
+      k.bytes += bytes;
+      ++k.count;
+      if (const uint64_t type = held & ((uint64_t(1) << kHeldTypeBits) - 1)) {
+        FootprintEntry& e = types[type];
+        e.bytes += bytes;
+        ++e.count;
+      }
+    }
+
+    auto bigger = [](const auto& a, const auto& b) { return a.second > b.second; };
+    const size_t top = std::min(topTasks, out.tasks.size());
+    std::partial_sort(out.tasks.begin(), out.tasks.begin() + top, out.tasks.end(), bigger);
+    out.tasks.resize(top);
+
+    auto byBytes = [](const FootprintEntry& a, const FootprintEntry& b) { return a.bytes > b.bytes; };
+    for (auto& [kind, e] : kinds) {
+      e.name = CostModel::kindName(kind);
+      out.byKind.push_back(std::move(e));
+    }
+    {
+      std::lock_guard<std::mutex> lk(heldTypesMutex);
+      for (auto& [type, e] : types) {
+        e.name = demangle(heldTypes[type - 1]->name());
+        out.byType.push_back(std::move(e));
+      }
+    }
+    std::sort(out.byKind.begin(), out.byKind.end(), byBytes);
+    std::sort(out.byType.begin(), out.byType.end(), byBytes);
+    return out;
+  }
+
+public:
+
+  /**
+   * @brief Включает подсчёт выделений памяти, сделанных задачами во время выполнения.
+   *
+   * Счёт идёт в stats().allocations/allocatedBytes и по видам задач
+   * (allocationsByKind). Нужен заменённый operator new, см. AllocationCounter;
+   * без него счётчики остаются нулевыми.
+   */
+  void setAllocationTracking(bool on = true) {
+    std::lock_guard<std::mutex> lk(evalMutex);
+    trackAllocations = on;
+  }
+
+  /// Выделения по видам задач, по убыванию байтов; виды без выделений не попадают.
+  std::vector<std::pair<std::string, AllocationCounter::Counts>> allocationsByKind() const {
+    std::lock_guard<std::mutex> lk(evalMutex);
+    std::vector<std::pair<std::string, AllocationCounter::Counts>> out;
+    for (uint32_t k = 0; k < kindAllocations.size(); ++k) {
+      if (kindAllocations[k].allocations) out.emplace_back(CostModel::kindName(k), kindAllocations[k]);
+    }
+    std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) { return a.second.bytes > b.second.bytes; });
+    return out;
+  }
+
+  /// Доступ к пулу буферов результатов; передаётся задачам как обычный аргумент.
+  BufferHandle buffers() { return BufferHandle(recycleTarget); }
+
+  BufferPool::Stats bufferStats() const { return recycleTarget->stats(); }
+
+  bool isParallel() const { return pool != nullptr; }
+
+  /// Число выданных id (задачи, добавляемые прямо сейчас, тоже учитываются).
+  size_t size() const { return nextId.load(std::memory_order_acquire); }
+
+private:
+  template<typename Signature>
+  friend class Subgraph;
+  template<typename S>
+  friend class FixedPoint;
+
+  struct Task;
+
+  /// Экземпляр Subgraph: выполняется на пуле родителя (или последовательно без него).
+  /// Задач в нём не больше, чем в body, поэтому первый сегмент задач — ровно под них.
+  TTaskScheduler(ThreadPool* shared, const TTaskScheduler& body) : tasks(body.size()), pool(shared) {}
+
+  /**
+   * @brief Заполняет пустой шедулер копией структуры body: задачи с теми же id
+   * и рёбрами, первые sizeof...(Params) задач возвращают params, остальные
+   * вызывают executor задачи body (замыкание из двух указателей — без выделения памяти).
+   * Параметр std::cref(x) читается при каждом выполнении (FixedPoint между итерациями меняет x).
+   * Буферы результатов экземпляр возвращает в пул body, откуда их берут callable тела.
+   */
+  template<typename... Params>
+  void instantiate(const TTaskScheduler& body, const Params&... params) {
+    const size_t n = body.size();
+    recycleTarget = body.recycleTarget;  // callable тела держат BufferHandle прототипа
+    nextId.store(n, std::memory_order_release);  // все рёбра — к уже выданным id
+    size_t i = 0;
+    auto bindParam = [&](const auto& value) {
+      tasks.ensure(i).executor = [value](TTaskScheduler&) {
+        const std::unwrap_reference_t<std::decay_t<decltype(value)>>& v = value;
+        return AnyValue(v);
+      };
+      ++i;
+    };
+    (bindParam(params), ...);
+    for (; i < n; ++i) {
+      const Task* proto = &body.tasks[i];
+      tasks.ensure(i).executor = [proto](TTaskScheduler& s) { return proto->executor(s); };
+    }
+    for (i = 0; i < n; ++i) {
+      const Task& proto = body.tasks[i];
+      Task& t = tasks[i];
+      t.id = static_cast<TaskId>(i);
+      t.kind.store(proto.kind.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      t.depCount = proto.depCount;
+      std::copy(proto.deps, proto.deps + proto.depCount, t.deps);
+      linkTask(t);
+    }
+  }
+
+  /// Ссылка аргумента на результат другой задачи.
+  struct DepRef {
+    TaskId id;
+  };
+
+  /**
+   * @brief Аргумент задачи: либо значение T, либо id задачи-зависимости.
+   * Для зависимости T не создаётся, поэтому T не обязан иметь конструктор по умолчанию.
+   */
+  template<typename T>
+  struct InputDesc {
+    std::variant<T, DepRef> slot;
+
+    InputDesc(T&& v) : slot(std::in_place_index<0>, std::move(v)) {}
+    InputDesc(const T& v) : slot(std::in_place_index<0>, v) {}
+    InputDesc(FutureResult<T> f) : slot(std::in_place_index<1>, DepRef{f.id}) {}
+
+    // Вызывается только когда все зависимости задачи уже вычислены. Результат
+    // входа отдаётся по ссылке: копию делает лишь callable, принимающий по значению.
+    const T& get(TTaskScheduler& s) const {
+      if (const T* v = std::get_if<0>(&slot)) return *v;
+      return s.template dependencyResult<T>(std::get<1>(slot).id);
+    }
+
+    void appendDep(Task& t) const {
+      if (const DepRef* d = std::get_if<1>(&slot)) t.deps[t.depCount++] = d->id;
+    }
+
+    std::optional<size_t> dependency() const {
+      if (const DepRef* d = std::get_if<1>(&slot)) return d->id;
+      return std::nullopt;
+    }
+  };
+
+  /// Аргумент Shared<T>: все задачи держат один экземпляр.
+  template<typename T>
+  struct SharedInput {
+    std::shared_ptr<const T> ptr;
+
+    SharedInput(Shared<T> v) : ptr(std::move(v.ptr)) {}
+    const T& get(TTaskScheduler&) const { return *ptr; }
+    void appendDep(Task&) const {}
+    std::optional<size_t> dependency() const { return std::nullopt; }
+  };
+
+  /// Аргумент Borrowed<T>: значение вызывающего кода.
+  template<typename T>
+  struct BorrowedInput {
+    const T* ptr;
+
+    BorrowedInput(Borrowed<T> v) : ptr(v.ptr) {}
+    const T& get(TTaskScheduler&) const { return *ptr; }
+    void appendDep(Task&) const {}
+    std::optional<size_t> dependency() const { return std::nullopt; }
+  };
+
+  /// Хранилище аргумента по типу, переданному в add().
+  template<typename A>
+  struct input_for { using type = InputDesc<typename unwrap_future<A>::type>; };
+
+  template<typename T>
+  struct input_for<Shared<T>> { using type = SharedInput<T>; };
+
+  template<typename T>
+  struct input_for<Borrowed<T>> { using type = BorrowedInput<T>; };
+
+  /// Ребро «вход -> потребитель»; хранится в самом потребителе, по одному на аргумент.
+  struct Edge {
+    Task* consumer = nullptr;
+    Edge* next = nullptr;
+  };
+
+  /**
+   * @brief Узел графа. Живёт в SegmentedArray и никогда не перемещается, поэтому
+   * на его поля можно ссылаться из других задач и потоков.
+   */
+  struct Task {
+    std::function<AnyValue(TTaskScheduler&)> executor;
+    AnyValue result;
+    Edge edges[2];                    ///< рёбра этой задачи в списках consumers её входов
+    /// Стек Трайбера рёбер потребителей; после завершения задачи — kClosed.
+    std::atomic<Edge*> consumers{nullptr};
+    Task* readyNext = nullptr;        ///< звено списка ready
+    TaskId id = 0;
+    TaskId deps[2] = {0, 0};          ///< id задач, результаты которых нужны этой задаче
+    std::atomic<uint32_t> pending{0}; ///< число не вычисленных входов
+    std::atomic<uint32_t> uses{0};    ///< число ещё не выполненных потребителей
+    uint8_t depCount = 0;
+    std::atomic<bool> published{false};
+    std::atomic<bool> rematerializable{false};
+    std::atomic<bool> pure{false};
+    std::atomic<uint32_t> kind{0};    ///< вид задачи в CostModel
+    /// Хранимый результат для footprint(): байты << kHeldBytesShift | номер типа
+    /// (или kHeldUnsized | номер типа, пока размеры не учитываются); 0 — результата нет.
+    std::atomic<uint64_t> held{0};
+
+    std::span<const TaskId> inputs() const { return {deps, depCount}; }
+  };
+
+  /// Метка закрытого списка потребителей: вход уже вычислен.
+  static Edge* closedList() { return reinterpret_cast<Edge*>(alignof(Edge)); }
+
+  // Пул объявлен раньше задач: результаты уничтожаются до него.
+  BufferPool bufferPool;
+  /// Куда возвращаются буферы результатов: свой пул, у экземпляра подграфа — пул прототипа.
+  BufferPool* recycleTarget = &bufferPool;
+  SegmentedArray<Task> tasks;
+  std::atomic<size_t> nextId{0};
+
+  // Статусы ниже принадлежат вычисляющему потоку; syncStatus() дотягивает их
+  // размер до числа выданных id в начале каждого вызова.
+  TaskBitset evaluated;  ///< результат задачи вычислен и лежит в Task::result
+  TaskBitset visiting;   ///< задача на стеке обхода конуса (вне вызова всегда пуст)
+  TaskBitset inCone;     ///< задача входит в конус текущего runCone (вне вызова всегда пуст)
+  TaskBitset dropped;    ///< задача вычислена, но её результат освобождён до востребования
+  TaskBitset speculationFailed;  ///< спекулятивный запуск бросил исключение — больше не пробуем
+  TaskBitset speculationCone;    ///< задача в уже обойдённом конусе объявленного выхода
+  bool wholeGraph = false;  ///< текущий runWork выполняет всё, что становится готовым
+  size_t executedUpTo = 0;  ///< все задачи с меньшим id вычислены
+  size_t memoryBudget = 0;
+  Stats counters;
+  /// Размер результата считается при завершении задачи: он нужен бюджету пересчёта,
+  /// обучению или метрикам. Иначе counters.residentBytes не ведётся, а размеры
+  /// досчитывают stats() и footprint(). Однажды включённый, не выключается.
+  bool sizeResults = false;
+
+  /// Задачи с оценкой дешевле этого в параллельном режиме выполняет сам координатор.
+  static constexpr double kInlineNs = 20'000;
+  /// Оценка для вида, которого модель ещё не видела.
+  static constexpr double kUnknownNs = 1'000;
+
+  CostModel costs;
+  bool learning = false;
+  bool trackAllocations = false;
+
+  /// Детерминированное расписание (только с пулом); всё под evalMutex.
+  enum class SchedulePolicy { Dynamic, Replay, Seeded };
+  SchedulePolicy policy = SchedulePolicy::Dynamic;
+  bool recording = false;
+  Schedule recorded;
+  Schedule replay;
+  size_t replayCursor = 0;  ///< следующий шаг replay
+  uint64_t scheduleRng = 0;
+  std::vector<AllocationCounter::Counts> kindAllocations;  ///< по номеру вида; пишет вычисляющий поток
+
+  std::atomic<uint32_t> sampleEvery{0};
+  uint32_t sampleCountdown = 0;  ///< событий до следующего замера
+  std::vector<KindLatency> latencies;  ///< по номеру вида; пишет только вычисляющий поток
+  size_t rematMinBytes = 0;
+  double rematMaxNs = 0;
+
+  /// Стек Трайбера задач с pending == 0; executeAll забирает его целиком.
+  std::atomic<Task*> ready{nullptr};
+
+  /// Рёбра к ещё не выданным id (зависимость «вперёд»); редкий путь под мьютексом.
+  /// Зависимость не дальше kForwardWindow от следующего id, иначе add() бросает
+  /// std::out_of_range — опечатка в id не должна выделять сегмент на миллионы задач.
+  static constexpr size_t kForwardWindow = size_t(1) << 20;
+  std::mutex forwardMutex;
+  std::unordered_map<size_t, std::vector<Edge*>> forwardConsumers;
+  std::atomic<size_t> forwardCount{0};
+
+  /// Владение состоянием вычисления: запрос или спекуляция (только с пулом).
+  mutable std::mutex evalMutex;
+  std::atomic<size_t> demandWaiting{0};  ///< запросы, ждущие evalMutex
+  std::atomic<bool> speculationOn{false};
+  std::atomic<bool> speculationQueued{false};
+  std::vector<size_t> declaredOutputs;   ///< под evalMutex
+  std::vector<size_t> coneRoots;         ///< под evalMutex: ещё не обойдённые в speculationCone задачи
+  std::deque<size_t> speculationFrontier;  ///< под evalMutex: готовые чистые задачи конусов
+
+  /// Метрики для наблюдения извне: снимок строит владелец evalMutex.
+  std::atomic<bool> metricsOn{false};
+  std::atomic<bool> metricsRequested{false};
+  std::atomic<uint64_t> metricsVersion{0};
+  std::mutex metricsMutex;  ///< только на подмену latestMetrics
+  std::shared_ptr<const Metrics> latestMetrics;
+  /// Типы хранимых результатов для footprint; дописывает вычисляющий поток под heldTypesMutex.
+  std::vector<const std::type_info*> heldTypes;
+  mutable std::mutex heldTypesMutex;
+  std::vector<uint16_t> heldTypeOfKind;  ///< последний номер типа по виду задачи; пишет вычисляющий поток
+  /// Как часто ждущий завершений координатор проверяет запрос снимка.
+  static constexpr auto kMetricsPoll = std::chrono::milliseconds(1);
+  /// Как часто помогающий координатор без чужих заданий проверяет свои завершения.
+  static constexpr auto kHelpPoll = std::chrono::microseconds(50);
+
+  std::unique_ptr<ThreadPool> ownedPool;
+  ThreadPool* pool = nullptr;  ///< ownedPool или пул родителя у экземпляра Subgraph
+
+  /// Захват состояния запросом; при освобождении снова планирует спекуляцию.
+  struct EvalLock {
+    TTaskScheduler& s;
+    bool locked;
+    explicit EvalLock(TTaskScheduler& sched)
+      : s(sched), locked(s.pool || s.metricsOn.load(std::memory_order_acquire)) {
+      if (!locked) return;
+      s.demandWaiting.fetch_add(1, std::memory_order_acq_rel);
+      s.evalMutex.lock();
+      s.demandWaiting.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    ~EvalLock() {
+      if (!locked) return;
+      s.evalMutex.unlock();
+      if (s.speculationOn.load(std::memory_order_relaxed)) s.scheduleSpeculation();
+    }
+  };
+
+  // Строит и публикует снимок; вызывается владельцем evalMutex.
+  void publishMetrics(bool evaluating, size_t inflight) {
+    metricsRequested.store(false, std::memory_order_relaxed);
+    auto m = std::make_shared<Metrics>();
+    m->evaluating = evaluating;
+    m->tasks = size();
+    m->queued = pool ? pool->queueDepth() : 0;
+    m->inflight = inflight;
+    m->stats = counters;
+    for (uint32_t k = 0; k < std::max(latencies.size(), kindAllocations.size()); ++k) {
+      const bool timed = k < latencies.size() && latencies[k].execution.count() + latencies[k].request.count() != 0;
+      const bool allocated = k < kindAllocations.size() && kindAllocations[k].allocations != 0;
+      if (!timed && !allocated) continue;
+      m->kinds.push_back({CostModel::kindName(k), timed ? latencies[k] : KindLatency(),
+                          allocated ? kindAllocations[k] : AllocationCounter::Counts()});
+    }
+    std::lock_guard<std::mutex> lk(metricsMutex);
+    m->version = metricsVersion.load(std::memory_order_relaxed) + 1;
+    latestMetrics = std::move(m);
+    metricsVersion.store(latestMetrics->version, std::memory_order_release);
+  }
+
+  void scheduleSpeculation() {
+    if (!pool || !speculationOn.load(std::memory_order_relaxed)) return;
+    if (speculationQueued.exchange(true, std::memory_order_acq_rel)) return;
+    pool->submitIdle([this] { speculate(); });
+  }
+
+  // Фоновое задание пула: выполняет готовые чистые задачи, пока нет запроса.
+  void speculate() {
+    speculationQueued.store(false, std::memory_order_release);
+    std::unique_lock<std::mutex> lk(evalMutex, std::try_to_lock);
+    if (!lk.owns_lock() || planned()) return;
+    syncStatus();
+    wholeGraph = false;
+
+    extendSpeculationCone();
+
+    std::vector<size_t> work;
+    while (!speculationFrontier.empty()) {
+      if (demandWaiting.load(std::memory_order_acquire) != 0) break;
+      if (!speculationOn.load(std::memory_order_relaxed)) break;
+      const size_t v = speculationFrontier.front();
+      speculationFrontier.pop_front();
+      Task& t = tasks[v];
+      if (evaluated.test(v) || speculationFailed.test(v) || t.pending.load(std::memory_order_acquire) != 0) continue;
+      Run run;
+      try {
+        materializeInputs(v);
+        run = execute(t);
+      } catch (...) {
+        speculationFailed.set(v);
+        continue;
+      }
+      finishTask(v, work, run);  // ставшие готовыми потребители уходят в ready и speculationFrontier
+      ++counters.speculated;
+      if (metricsRequested.load(std::memory_order_relaxed)) publishMetrics(false, 0);
+    }
+  }
+
+  // Дописывает в speculationCone конусы задач из coneRoots, не заходя в вычисленные
+  // задачи; готовые чистые задачи конуса попадают в speculationFrontier, а дальше
+  // его пополняет finishTask. Каждая задача обходится один раз до reset(); ещё не
+  // добавленные (зависимость «вперёд») остаются в coneRoots до следующего раза.
+  void extendSpeculationCone() {
+    if (coneRoots.empty()) return;
+    std::vector<size_t> stack(coneRoots.rbegin(), coneRoots.rend());  // выходы в порядке объявления
+    coneRoots.clear();
+    while (!stack.empty()) {
+      const size_t v = stack.back();
+      stack.pop_back();
+      const Task* t = v < speculationCone.size() ? tasks.find(v) : nullptr;
+      if (!t || !t->published.load(std::memory_order_acquire)) {
+        coneRoots.push_back(v);
+        continue;
+      }
+      if (speculationCone.test(v) || evaluated.test(v)) continue;
+      speculationCone.set(v);
+      if (t->pending.load(std::memory_order_acquire) == 0) offerSpeculation(v);
+      for (const TaskId d : t->inputs()) stack.push_back(d);
+    }
+  }
+
+  void offerSpeculation(size_t v) {
+    if (tasks[v].pure.load(std::memory_order_relaxed) && !speculationFailed.test(v)) speculationFrontier.push_back(v);
+  }
+
+  // Конусы обходятся заново от объявленных выходов (после reset() задачи снова не вычислены).
+  void reseedSpeculation() {
+    speculationCone.clear();
+    speculationFrontier.clear();
+    coneRoots = declaredOutputs;
+  }
+
+  void syncStatus() {
+    const size_t n = size();
+    if (evaluated.size() >= n) return;
+    evaluated.resize(n);
+    visiting.resize(n);
+    inCone.resize(n);
+    dropped.resize(n);
+    speculationFailed.resize(n);
+    speculationCone.resize(n);
+  }
+
+  // Задача v после того, как добавивший её поток закончил add().
+  Task& publishedTask(size_t v) {
+    Task& t = tasks.ensure(v);
+    while (!t.published.load(std::memory_order_acquire)) std::this_thread::yield();
+    return t;
+  }
+
+  void pushReady(Task& t) {
+    Task* head = ready.load(std::memory_order_relaxed);
+    do {
+      t.readyNext = head;
+    } while (!ready.compare_exchange_weak(head, &t, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  // Кладёт ребро в список потребителей входа; false, если вход уже вычислен.
+  static bool pushConsumer(Task& input, Edge& e) {
+    Edge* head = input.consumers.load(std::memory_order_acquire);
+    do {
+      if (head == closedList()) return false;
+      e.next = head;
+    } while (!input.consumers.compare_exchange_weak(head, &e, std::memory_order_acq_rel, std::memory_order_acquire));
+    return true;
+  }
+
+  /**
+   * @brief Регистрирует рёбра только что добавленной задачи.
+   *
+   * pending стартует с depCount + 1: лишняя единица не даёт задаче стать готовой,
+   * пока регистрация не закончена. Вход, чей список уже закрыт, вычислен — его
+   * сразу вычитаем. Задача публикуется до того, как попадёт в ready, а
+   * вычисляющий поток ждёт публикации любой встреченной задачи.
+   */
+  void linkTask(Task& t) {
+    t.pending.store(uint32_t(t.depCount) + 1, std::memory_order_relaxed);
+    uint32_t resolved = 1;
+
+    for (uint8_t k = 0; k < t.depCount; ++k) {
+      const size_t d = t.deps[k];
+      Edge& e = t.edges[k];
+      e.consumer = &t;
+      tasks.ensure(d).uses.fetch_add(1, std::memory_order_relaxed);
+      if (!linkForward(d, e) && !pushConsumer(tasks.ensure(d), e)) ++resolved;
+    }
+
+    if (forwardCount.load() != 0) {
+      std::vector<Edge*> early;
+      {
+        std::lock_guard<std::mutex> lk(forwardMutex);
+        auto it = forwardConsumers.find(t.id);
+        if (it != forwardConsumers.end()) {
+          early = std::move(it->second);
+          forwardConsumers.erase(it);
+          forwardCount.fetch_sub(1);
+        }
+      }
+      for (Edge* e : early) pushConsumer(t, *e);
+    }
+
+    const bool isReady = t.pending.fetch_sub(resolved, std::memory_order_acq_rel) == resolved;
+    t.published.store(true, std::memory_order_release);
+    if (isReady) pushReady(t);
+  }
+
+  static void checkDependency(std::optional<size_t> dep, size_t limit) {
+    if (dep && *dep >= limit) throw std::out_of_range("Dependency id out of range");
+  }
+
+  // Зависимость на ещё не выданный id: ребро ждёт в forwardConsumers, пока
+  // задачу с этим id не добавят. seq_cst на forwardCount и nextId гарантирует,
+  // что либо мы увидим выданный id, либо его владелец увидит наше ребро.
+  bool linkForward(size_t d, Edge& e) {
+    if (d < nextId.load()) return false;
+    std::lock_guard<std::mutex> lk(forwardMutex);
+    auto& waiting = forwardConsumers[d];
+    if (waiting.empty()) forwardCount.fetch_add(1);
+    if (d < nextId.load()) {
+      if (waiting.empty()) {
+        forwardConsumers.erase(d);
+        forwardCount.fetch_sub(1);
+      }
+      return false;
+    }
+    waiting.push_back(&e);
+    return true;
+  }
+
+  /// Замеры одного выполнения задачи.
+  struct Run {
+    uint64_t ns = 0;
+    AllocationCounter::Counts allocs;
+  };
+
+  static uint64_t packHeld(size_t bytes, uint64_t type) {
+    return std::min<uint64_t>(bytes, kHeldBytesMax) << kHeldBytesShift | type;
+  }
+
+  // Размер хранимого результата задачи. Неизмеренный читает сам результат —
+  // такие бывают только без enableMetrics, когда чужого вычисления нет.
+  size_t heldBytes(const Task& t) const {
+    const uint64_t held = t.held.load(std::memory_order_relaxed);
+    if (held & kHeldUnsized) return t.result.bytes();
+    return static_cast<size_t>(held >> kHeldBytesShift);
+  }
+
+  // Учитывает новый результат задачи: номер типа для footprint всегда, а размер —
+  // только при sizeResults (тогда же он уходит в модель стоимости).
+  void holdResult(Task& t, const Run& run) {
+    const uint64_t type = heldTypeNumber(t);
+    if (!sizeResults) {
+      t.held.store(t.result.type() ? kHeldUnsized | type : 0, std::memory_order_relaxed);
+      return;
+    }
+    const size_t bytes = t.result.bytes();
+    counters.residentBytes += bytes;
+    t.held.store(packHeld(bytes, type), std::memory_order_relaxed);
+    if (learning) costs.record(t.kind.load(std::memory_order_relaxed), run.ns, bytes);
+  }
+
+  // Включает sizeResults и измеряет уже хранимые результаты. Под evalMutex или вне вычисления.
+  void trackResultSizes() {
+    if (sizeResults) return;
+    sizeResults = true;
+    counters.residentBytes = 0;
+    for (size_t i = 0, n = size(); i < n; ++i) {
+      Task* t = tasks.find(i);
+      const uint64_t held = t ? t->held.load(std::memory_order_relaxed) : 0;
+      if (!(held & kHeldUnsized)) continue;
+      const size_t bytes = t->result.bytes();
+      counters.residentBytes += bytes;
+      t->held.store(packHeld(bytes, held & (kHeldUnsized - 1)), std::memory_order_relaxed);
+    }
+  }
+
+  // Номер типа результата задачи. Вид задачи почти всегда даёт один и тот же
+  // тип, поэтому номер берётся из heldTypeOfKind и лишь при промахе ищется в heldTypes.
+  uint64_t heldTypeNumber(const Task& t) {
+    const std::type_info* type = t.result.type();
+    if (!type) return 0;
+    const uint32_t kind = t.kind.load(std::memory_order_relaxed);
+    if (kind < heldTypeOfKind.size()) {
+      const uint16_t cached = heldTypeOfKind[kind];
+      if (cached && heldTypes[cached - 1] == type) return cached;
+    }
+    const uint64_t number = findHeldType(type);
+    if (number) {
+      if (kind >= heldTypeOfKind.size()) heldTypeOfKind.resize(kind + 1);
+      heldTypeOfKind[kind] = static_cast<uint16_t>(number);
+    }
+    return number;
+  }
+
+  // Номер типа: 1 + индекс в heldTypes; 0 — номера кончились.
+  uint64_t findHeldType(const std::type_info* type) {
+    for (size_t i = 0; i < heldTypes.size(); ++i) {
+      if (heldTypes[i] == type || *heldTypes[i] == *type) return i + 1;
+    }
+    if (heldTypes.size() + 1 >= (size_t(1) << kHeldTypeBits)) return 0;
+    std::lock_guard<std::mutex> lk(heldTypesMutex);
+    heldTypes.push_back(type);
+    return heldTypes.size();
+  }
+
+  // Отмечает задачу вычисленной и уведомляет потребителей. Ставшие готовыми
+  // потребители из текущего множества выполнения попадают в work, прочие — в ready.
+  void finishTask(size_t id, std::vector<size_t>& work, const Run& run, bool sampled = false) {
+    Task& t = tasks[id];
+    if (id >= evaluated.size()) syncStatus();  // задачу добавили уже во время этого вызова
+    evaluated.set(id);
+    ++counters.executions;
+    holdResult(t, run);
+    if (sampled) latencyOf(t).execution.record(run.ns);
+    recordAllocations(t, run.allocs);
+    for (const TaskId d : t.inputs()) {
+      if (tasks[d].uses.fetch_sub(1, std::memory_order_acq_rel) == 1) maybeDrop(d);
+    }
+    Edge* e = t.consumers.exchange(closedList(), std::memory_order_acq_rel);
+    for (; e; e = e->next) {
+      Task& c = *e->consumer;
+      if (c.pending.fetch_sub(1, std::memory_order_acq_rel) != 1) continue;
+      if (wholeGraph || inCone.test(c.id)) {
+        work.push_back(c.id);
+      } else {
+        pushReady(c);
+        if (speculationCone.test(c.id)) offerSpeculation(c.id);
+      }
+    }
+  }
+
+  /**
+   * @brief Выполняет задачу и пишет результат в Task::result.
+   * @return время выполнения в нс, если задача замеряется (timed) или включено
+   * обучение модели стоимости, иначе 0.
+   */
+  Run execute(Task& t, bool timed = false) {
+    Run run;
+    if (!learning && !timed && !trackAllocations) {
+      t.result = t.executor(*this);
+      return run;
+    }
+    const AllocationCounter::Counts before = AllocationCounter::current();
+    const bool measure = learning || timed;
+    const auto start = measure ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    t.result = t.executor(*this);
+    if (measure) run.ns = nanosSince(start);
+    if (trackAllocations) run.allocs = AllocationCounter::current() - before;
+    return run;
+  }
+
+  void recordAllocations(const Task& t, const AllocationCounter::Counts& c) {
+    if (!c.allocations) return;
+    counters.allocations += c.allocations;
+    counters.allocatedBytes += c.bytes;
+    const uint32_t kind = t.kind.load(std::memory_order_relaxed);
+    if (kind >= kindAllocations.size()) kindAllocations.resize(kind + 1);
+    kindAllocations[kind] += c;
+  }
+
+  static uint64_t nanosSince(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+  }
+
+  // Решение о замере очередного события (1 из sampleEvery).
+  bool sampleNext() {
+    if (sampleCountdown > 1) {
+      --sampleCountdown;
+      return false;
+    }
+    sampleCountdown = sampleEvery.load(std::memory_order_relaxed);
+    return sampleCountdown != 0;
+  }
+
+  KindLatency& latencyOf(const Task& t) {
+    const uint32_t kind = t.kind.load(std::memory_order_relaxed);
+    if (kind >= latencies.size()) latencies.resize(kind + 1);
+    return latencies[kind];
+  }
+
+  double estimateNs(size_t id) const {
+    const uint32_t kind = tasks[id].kind.load(std::memory_order_relaxed);
+    return costs.known(kind) ? costs.estimateNs(kind) : kUnknownNs;
+  }
+
+  bool isRematerializable(const Task& t) const {
+    if (t.rematerializable.load(std::memory_order_relaxed)) return true;
+    if (rematMinBytes == 0) return false;
+    const uint32_t kind = t.kind.load(std::memory_order_relaxed);
+    return costs.known(kind) && costs.estimateBytes(kind) >= static_cast<double>(rematMinBytes) &&
+           costs.estimateNs(kind) <= rematMaxNs;
+  }
+
+  // Освобождает результат пересчитываемой задачи, все потребители которой выполнены.
+  void maybeDrop(size_t id) {
+    Task& t = tasks[id];
+    if (!isRematerializable(t) || dropped.test(id)) return;
+    if (t.uses.load(std::memory_order_acquire) != 0 || counters.residentBytes <= memoryBudget) return;
+    counters.residentBytes -= t.result.bytes();
+    t.result.recycleInto(*recycleTarget);
+    t.held.store(0, std::memory_order_relaxed);
+    dropped.set(id);
+    ++counters.dropped;
+  }
+
+  /**
+   * @brief Заново вычисляет освобождённый результат задачи root.
+   *
+   * Освобождённые входы пересчитываются рекурсивно (обход в глубину без
+   * рекурсии), а после вычисления root снова освобождаются. Счётчики и списки
+   * потребителей не трогаются: для графа задачи остаются вычисленными.
+   */
+  void rematerialize(size_t root) {
+    std::vector<std::pair<size_t, size_t>> stack{{root, 0}};
+    std::vector<size_t> restored;
+    while (!stack.empty()) {
+      auto& [v, next] = stack.back();
+      const auto deps = tasks[v].inputs();
+      if (next < deps.size()) {
+        const size_t d = deps[next++];
+        if (dropped.test(d)) stack.emplace_back(d, 0);
+        continue;
+      }
+      const size_t done = v;
+      stack.pop_back();
+      Task& t = tasks[done];
+      const Run run = execute(t);
+      dropped.reset(done);
+      ++counters.recomputes;
+      holdResult(t, run);
+      recordAllocations(t, run.allocs);
+      if (done != root) restored.push_back(done);
+    }
+    for (size_t v : restored) maybeDrop(v);
+  }
+
+  // Перед запуском задачи её входы должны лежать в памяти.
+  void materializeInputs(size_t id) {
+    for (const TaskId d : tasks[id].inputs()) {
+      if (dropped.test(d)) rematerialize(d);
+    }
+  }
+
+  template<typename T>
+  const T& dependencyResult(size_t id) const {
+    const T* p = tasks[id].result.template try_cast<T>();
+    if (!p) throw std::runtime_error("Bad result type requested in getResult");
+    return *p;
+  }
+
+  /// Задано ли расписание (replaySchedule или randomSchedule) для вычисления на пуле.
+  bool planned() const { return pool && policy != SchedulePolicy::Dynamic; }
+
+  /**
+   * @brief План запуска невычисленного конуса: при replaySchedule — очередные
+   * шаги записи, относящиеся к конусу; при randomSchedule — случайный
+   * топологический порядок конуса со случайными потоками пула.
+   */
+  std::vector<typename Schedule::Step> planFor(const std::vector<size_t>& cone) {
+    std::vector<typename Schedule::Step> plan;
+    if (policy == SchedulePolicy::Replay) {
+      while (replayCursor < replay.steps.size()) {
+        const auto& step = replay.steps[replayCursor];
+        if (step.task >= evaluated.size()) break;
+        if (!evaluated.test(step.task)) {
+          if (!inCone.test(step.task)) break;  // шаг следующего вызова
+          plan.push_back(step);
+        }
+        ++replayCursor;
+      }
+      return plan;
+    }
+
+    // Кан со случайным выбором среди готовых; рёбра конуса — в CSR по локальным номерам.
+    std::unordered_map<size_t, uint32_t> local;
+    local.reserve(cone.size());
+    for (uint32_t i = 0; i < cone.size(); ++i) local.emplace(cone[i], i);
+    std::vector<uint32_t> pendingIn(cone.size()), first(cone.size() + 1), consumers;
+    for (uint32_t i = 0; i < cone.size(); ++i) {
+      for (const TaskId d : tasks[cone[i]].inputs()) {
+        auto it = local.find(d);
+        if (it == local.end()) continue;
+        ++pendingIn[i];
+        ++first[it->second + 1];
+      }
+    }
+    for (size_t i = 0; i < cone.size(); ++i) first[i + 1] += first[i];
+    consumers.resize(first.back());
+    std::vector<uint32_t> fill(first.begin(), first.end() - 1), readyNow;
+    for (uint32_t i = 0; i < cone.size(); ++i) {
+      for (const TaskId d : tasks[cone[i]].inputs()) {
+        auto it = local.find(d);
+        if (it != local.end()) consumers[fill[it->second]++] = i;
+      }
+      if (pendingIn[i] == 0) readyNow.push_back(i);
+    }
+    auto random = [this] {
+      uint64_t x = (scheduleRng += 0x9e3779b97f4a7c15ULL);
+      x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+      return x ^ (x >> 31);
+    };
+    plan.reserve(cone.size());
+    while (!readyNow.empty()) {
+      const size_t pick = random() % readyNow.size();
+      const uint32_t i = readyNow[pick];
+      readyNow[pick] = readyNow.back();
+      readyNow.pop_back();
+      plan.push_back({static_cast<TaskId>(cone[i]), static_cast<uint32_t>(1 + random() % pool->size())});
+      for (uint32_t e = first[i]; e < first[i + 1]; ++e) {
+        if (--pendingIn[consumers[e]] == 0) readyNow.push_back(consumers[e]);
+      }
+    }
+    return plan;
+  }
+
+  /**
+   * @brief Вычисляет задачи [first, last) вместе с конусом их зависимостей.
+   *
+   * Конус находится итеративным обходом в глубину по deps (без рекурсии, поэтому
+   * глубина цепочек не ограничена стеком). Для невычисленных задач конуса их
+   * счётчик pending совпадает с числом входов внутри конуса, поэтому готовые к
+   * запуску — ровно задачи конуса с pending == 0.
+   */
+  void runCone(const size_t* first, const size_t* last) {
+    std::vector<size_t> cone;
+    auto unmark = [&] {
+      for (size_t v : cone) inCone.reset(v);
+    };
+
+    try {
+      collectCone(first, last, cone);
+
+      std::vector<size_t> work;
+      for (size_t v : cone) {
+        if (tasks[v].pending.load(std::memory_order_relaxed) == 0) work.push_back(v);
+      }
+      // Ранги нужны, только если часть конуса уйдёт в пул.
+      if (planned()) {
+        const auto plan = planFor(cone);
+        runWork(work, false, nullptr, &plan);
+      } else if (pool && !costs.empty() &&
+          std::any_of(cone.begin(), cone.end(), [this](size_t v) { return estimateNs(v) >= kInlineNs; })) {
+        const auto rank = criticalPathRanks(cone);
+        runWork(work, false, &rank);
+      } else {
+        runWork(work, false);
+      }
+    } catch (...) {
+      unmark();
+      throw;
+    }
+    unmark();
+  }
+
+  /**
+   * @brief Находит невычисленные задачи конуса [first, last) и дописывает их в
+   * cone входами вперёд, помечая в inCone (снимать метки — забота вызывающего,
+   * в том числе при исключении).
+   */
+  void collectCone(const size_t* first, const size_t* last, std::vector<size_t>& cone) {
+    std::vector<std::pair<size_t, size_t>> stack;  // (задача, индекс следующего входа)
+
+    auto enter = [&](size_t v) {
+      if (v >= size()) throw std::out_of_range("Task id out of range");
+      if (v >= evaluated.size()) syncStatus();
+      if (evaluated.test(v) || inCone.test(v)) return;
+      if (visiting.test(v)) throw std::runtime_error("Cyclic dependency detected");
+      if (!publishedTask(v).executor) throw std::runtime_error("Task has no executor");
+      visiting.set(v);
+      stack.emplace_back(v, 0);
+    };
+
+    try {
+      for (const size_t* r = first; r != last; ++r) {
+        enter(*r);
+        while (!stack.empty()) {
+          auto& [v, next] = stack.back();
+          const auto deps = tasks[v].inputs();
+          if (next < deps.size()) {
+            enter(deps[next++]);
+            continue;
+          }
+          size_t done = v;
+          stack.pop_back();
+          visiting.reset(done);
+          inCone.set(done);
+          cone.push_back(done);
+        }
+      }
+    } catch (...) {
+      for (auto& frame : stack) visiting.reset(frame.first);
+      throw;
+    }
+  }
+
+  /**
+   * @brief Длина самого дорогого пути от задачи конуса до его корня по оценкам
+   * модели стоимости. cone упорядочен входами вперёд, поэтому обратный проход
+   * видит всех потребителей задачи раньше неё самой.
+   */
+  std::unordered_map<size_t, double> criticalPathRanks(const std::vector<size_t>& cone) const {
+    std::unordered_map<size_t, double> rank;
+    rank.reserve(cone.size());
+    for (size_t v : cone) rank[v] = estimateNs(v);
+    for (auto it = cone.rbegin(); it != cone.rend(); ++it) {
+      const double below = rank[*it];
+      for (const TaskId d : tasks[*it].inputs()) {
+        auto r = rank.find(d);
+        if (r != rank.end()) r->second = std::max(r->second, estimateNs(d) + below);
+      }
+    }
+    return rank;
+  }
+
+  /**
+   * @brief Выполняет готовые задачи из work и всё, что становится готовым следом.
+   *
+   * Последовательно — прямо в вызывающем потоке. В параллельном режиме вызывающий
+   * поток только координирует: отправляет готовые задачи в пул и по сообщениям о
+   * завершении обновляет статусы и счётчики. Рабочие потоки пишут лишь в result
+   * своей задачи и читают результаты уже вычисленных входов, поэтому остальное
+   * состояние шедулера трогает только координатор.
+   *
+   * Если передан rank, первой запускается готовая задача с наибольшим рангом
+   * (самый дорогой оставшийся путь). Задачи, которые по модели стоимости
+   * дешевле kInlineNs, координатор выполняет сам: передача в пул стоила бы дороже.
+   */
+  void runWork(std::vector<size_t>& work, bool all, const std::unordered_map<size_t, double>* rank = nullptr,
+               const std::vector<typename Schedule::Step>* plan = nullptr) {
+    wholeGraph = all;
+    if (!pool) {
+      while (!work.empty()) {
+        size_t v = work.back();
+        work.pop_back();
+        if (evaluated.test(v)) continue;
+        if (recording) recorded.steps.push_back({static_cast<TaskId>(v), 0});
+        materializeInputs(v);
+        const bool sampled = sampleNext();
+        finishTask(v, work, execute(tasks[v], sampled), sampled);
+        if (metricsRequested.load(std::memory_order_relaxed)) publishMetrics(true, 0);
+      }
+      return;
+    }
+
+    auto rankOf = [rank](size_t v) {
+      auto it = rank->find(v);
+      return it == rank->end() ? 0.0 : it->second;
+    };
+    auto byRank = [&rankOf](size_t a, size_t b) { return rankOf(a) < rankOf(b); };
+    size_t heapSize = 0;
+    auto runsInline = [this](size_t v) {
+      const uint32_t kind = tasks[v].kind.load(std::memory_order_relaxed);
+      return costs.known(kind) && costs.estimateNs(kind) < kInlineNs;
+    };
+
+    struct Completion {
+      size_t id;
+      std::exception_ptr error;
+      Run run;
+      uint64_t waitNs;
+      bool sampled;
+      size_t worker;    ///< номер потока пула
+      size_t recordAt;  ///< шаг в recorded или kNoStep
+    };
+    constexpr size_t kAnyWorker = size_t(-1), kNoStep = size_t(-1);
+    const bool planSet = plan != nullptr;
+    size_t planNext = 0;
+    auto inputsReady = [this](size_t v) {
+      for (const TaskId d : tasks[v].inputs()) {
+        if (!evaluated.test(d)) return false;
+      }
+      return true;
+    };
+    std::mutex m;
+    std::counting_semaphore<> signal{0};
+    std::vector<Completion> done, batch;
+    std::exception_ptr firstError;
+    size_t inflight = 0;
+
+    for (;;) {
+      while (!firstError) {
+        size_t v;
+        size_t worker = kAnyWorker;
+        if (plan && planNext < plan->size()) {
+          // По плану: следующая задача ждёт своих входов, даже если готовы другие.
+          const auto& step = (*plan)[planNext];
+          if (evaluated.test(step.task)) {
+            ++planNext;
+            continue;
+          }
+          if (!inputsReady(step.task)) {
+            if (inflight != 0) break;
+            plan = nullptr;  // план не сходится с графом — дальше как обычно
+            continue;
+          }
+          ++planNext;
+          v = step.task;
+          worker = step.worker;
+        } else {
+          // После плана work хранит и отданные по плану задачи: сначала дожидаемся их.
+          if (work.empty() || (planSet && inflight != 0)) break;
+          if (rank) {
+            // work — двоичная куча по рангу; finishTask дописывает в конец.
+            while (heapSize < work.size()) std::push_heap(work.begin(), work.begin() + ++heapSize, byRank);
+            std::pop_heap(work.begin(), work.end(), byRank);
+            --heapSize;
+          }
+          v = work.back();
+          work.pop_back();
+          if (evaluated.test(v)) continue;
+          if (planSet) ++counters.unplanned;
+        }
+        // Пока в пуле есть задачи, ссылающиеся на m и signal, исключение не
+        // должно покидать runWork — его отдаём после ожидания всех задач.
+        try {
+          materializeInputs(v);
+          if (worker == 0 || (worker == kAnyWorker && runsInline(v))) {
+            if (recording) recorded.steps.push_back({static_cast<TaskId>(v), 0});
+            const bool sampled = sampleNext();
+            finishTask(v, work, execute(tasks[v], sampled), sampled);
+            continue;
+          }
+        } catch (...) {
+          firstError = std::current_exception();
+          continue;
+        }
+        ++inflight;
+        const size_t recordAt = recording ? recorded.steps.size() : kNoStep;
+        if (recording) recorded.steps.push_back({static_cast<TaskId>(v), 0});
+        const bool sampled = sampleNext();
+        const auto submitted = sampled ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        auto job = [this, v, sampled, submitted, recordAt, &m, &signal, &done] {
+          std::exception_ptr error;
+          const uint64_t waitNs = sampled ? nanosSince(submitted) : 0;
+          Run run;
+          try {
+            run = execute(tasks[v], sampled);
+          } catch (...) {
+            error = std::current_exception();
+          }
+          // release() под мьютексом: координатор не уничтожит signal, пока не
+          // заберёт это сообщение, а для этого ему нужен тот же мьютекс.
+          std::lock_guard<std::mutex> lk(m);
+          done.push_back({v, error, run, waitNs, sampled, ThreadPool::currentWorker(), recordAt});
+          signal.release();
+        };
+        if (worker == kAnyWorker) {
+          pool->submit(std::move(job));
+        } else {
+          pool->submitTo((worker - 1) % pool->size(), std::move(job));
+        }
+      }
+      if (inflight == 0) break;
+
+      if (ThreadPool::current() == pool) {
+        // Координатор — поток того же пула (экземпляр Subgraph): блокироваться
+        // нельзя, иначе вложенные подграфы займут все потоки. Пока ждём, помогаем.
+        while (!signal.try_acquire()) {
+          if (!pool->runPending() && signal.try_acquire_for(kHelpPoll)) break;
+        }
+      } else if (!metricsOn.load(std::memory_order_relaxed)) {
+        signal.acquire();
+      } else {
+        while (!signal.try_acquire_for(kMetricsPoll)) {
+          if (metricsRequested.load(std::memory_order_relaxed)) publishMetrics(true, inflight);
+        }
+      }
+      {
+        std::lock_guard<std::mutex> lk(m);
+        batch.swap(done);
+      }
+      for (const Completion& c : batch) {
+        --inflight;
+        if (c.recordAt != kNoStep) recorded.steps[c.recordAt].worker = static_cast<uint32_t>(c.worker + 1);
+        if (c.error) {
+          if (!firstError) firstError = c.error;
+        } else {
+          if (c.sampled) latencyOf(tasks[c.id]).queueWait.record(c.waitNs);
+          finishTask(c.id, work, c.run, c.sampled);
+        }
+      }
+      batch.clear();
+      if (metricsRequested.load(std::memory_order_relaxed)) publishMetrics(true, inflight);
+    }
+    if (firstError) std::rethrow_exception(firstError);
+  }
+
+  template<typename Fnc, typename Tuple>
+  static AnyValue invoke_callable(Fnc& f, const Tuple& inputs, TTaskScheduler& sched) {
+    constexpr size_t N = std::tuple_size<Tuple>::value;
+    return invoke_impl(f, inputs, sched, std::integral_constant<size_t, N>{});
+  }
+
+  template<typename Fnc, typename Tuple>
+  static AnyValue invoke_impl(Fnc& f, const Tuple&, TTaskScheduler&, std::integral_constant<size_t, 0>) {
+    using R = std::invoke_result_t<Fnc>;
+    if constexpr (std::is_void<R>::value) {
+      std::invoke(f);
+      return AnyValue();
+    } else {
+      R r = std::invoke(f);
+      return AnyValue(std::move(r));
+    }
+  }
+
+  template<typename Fnc, typename Tuple>
+  static AnyValue invoke_impl(Fnc& f, const Tuple& tpl, TTaskScheduler& sched, std::integral_constant<size_t, 1>) {
+    auto& a0 = std::get<0>(tpl);
+    return invoke_args(f, a0.get(sched));
+  }
+
+  template<typename Fnc, typename Tuple>
+  static AnyValue invoke_impl(Fnc& f, const Tuple& tpl, TTaskScheduler& sched, std::integral_constant<size_t, 2>) {
+    auto& a0 = std::get<0>(tpl);
+    auto& a1 = std::get<1>(tpl);
+    return invoke_args(f, a0.get(sched), a1.get(sched));
+  }
+
+  // Аргументы передаются callable по const-ссылке. Если так его не вызвать
+  // (например, неконстантный метод объекта-аргумента), передаются копии.
+  template<typename Fnc, typename... V>
+  static AnyValue invoke_args(Fnc& f, const V&... v) {
+    if constexpr (std::is_invocable_v<Fnc&, const V&...>) {
+      using R = std::invoke_result_t<Fnc&, const V&...>;
+      if constexpr (std::is_void<R>::value) {
+        std::invoke(f, v...);
+        return AnyValue();
+      } else {
+        R r = std::invoke(f, v...);
+        return AnyValue(std::move(r));
+      }
+    } else {
+      using R = std::invoke_result_t<Fnc&, V...>;
+      if constexpr (std::is_void<R>::value) {
+        invoke_copies(f, V(v)...);
+        return AnyValue();
+      } else {
+        R r = invoke_copies(f, V(v)...);
+        return AnyValue(std::move(r));
+      }
+    }
+  }
+
+  // Метод вызывается прямо на копии объекта: std::invoke над указателем на
+  // метод даёт у GCC ложный -Warray-bounds для объектов меньше указателя.
+  template<typename Fnc, typename Obj, typename... V>
+  static decltype(auto) invoke_copies(Fnc& f, Obj obj, V&&... v) {
+    if constexpr (std::is_member_function_pointer_v<Fnc> && requires { (obj.*f)(std::forward<V>(v)...); }) {
+      return (obj.*f)(std::forward<V>(v)...);
+    } else {
+      return std::invoke(f, std::move(obj), std::forward<V>(v)...);
+    }
+  }
+};
+
+/**
+ * @class Subgraph
+ * @brief Переиспользуемый блок графа, который родительский шедулер видит одной задачей.
+ *
+ * Тело строится один раз, в конструкторе: build(body, FutureResult<Args>...)
+ * добавляет задачи в шедулер-прототип, получая входы блока как обычные
+ * зависимости, и возвращает id выходной задачи или её FutureResult<R>.
+ * Subgraph — callable R(const Args&...), поэтому экземпляр блока добавляется
+ * обычным add(sub, входы...); копии Subgraph разделяют одно тело.
+ *
+ * Каждый вызов создаёт экземпляр со своими результатами и счётчиками, а
+ * callable и аргументы задач берёт из прототипа. Экземпляр — это полноценный
+ * TTaskScheduler на стеке (несколько КБ) и массив задач ровно по размеру тела
+ * (тело меньше 128 задач не получает целый первый сегмент). На потоке пула экземпляр
+ * выполняет внутренние задачи на том же пуле (пока он ждёт, поток выполняет
+ * чужие задания, см. ThreadPool::runPending), вне пула — последовательно.
+ * Callable тела вызываются из разных экземпляров одновременно и не должны
+ * менять своё состояние.
+ */
+template<typename R, typename... Args>
+class Subgraph<R(Args...)> {
+public:
+  static_assert(sizeof...(Args) <= 2, "Максимум 2 аргумента поддерживается");
+
+  template<typename Build>
+  explicit Subgraph(Build&& build) {
+    auto b = std::make_shared<Body>();
+    TTaskScheduler& g = b->proto;
+    // Фигурные скобки задают порядок: входы блока получают id 0, 1, ...
+    std::tuple<FutureResult<Args>...> params{FutureResult<Args>(g.add(Param<Args>{}))...};
+    const auto out = std::apply([&](const auto&... p) { return build(g, p...); }, params);
+    if constexpr (std::is_same_v<std::decay_t<decltype(out)>, FutureResult<R>>) {
+      b->output = out.id;
+    } else {
+      b->output = out;
+    }
+    if (b->output >= g.size()) throw std::out_of_range("Subgraph output id out of range");
+    body = std::move(b);
+  }
+
+  R operator()(const Args&... args) const {
+    TTaskScheduler instance(ThreadPool::current(), body->proto);
+    instance.instantiate(body->proto, args...);
+    return instance.template getResult<R>(body->output);
+  }
+
+  /// Число задач тела, включая входы блока.
+  size_t size() const { return body->proto.size(); }
+
+  /// Пул буферов тела: его отдаёт g.buffers() при построении, в него экземпляры возвращают результаты.
+  BufferPool::Stats bufferStats() const { return body->proto.bufferStats(); }
+
+private:
+  template<typename S>
+  friend class FixedPoint;
+
+  /// Вход блока: значение подставляет instantiate, сам callable не вызывается.
+  template<typename T>
+  struct Param {
+    T operator()() const { throw std::logic_error("Subgraph parameter is bound per instance"); }
+  };
+
+  struct Body {
+    TTaskScheduler proto;
+    size_t output = 0;
+  };
+
+  std::shared_ptr<const Body> body;
+};
+
+/**
+ * @class FixedPoint
+ * @brief Цикл без развёртки в цепочку add(): тело-шаг S -> S выполняется
+ * повторно, пока done(предыдущее, новое) не вернёт true или не будет
+ * достигнуто maxIterations итераций.
+ *
+ * Тело строится один раз, как у Subgraph: build(body, FutureResult<S> state)
+ * возвращает задачу со следующим состоянием. Вызов создаёт один экземпляр тела
+ * и между итерациями сбрасывает его (reset): задачи, рёбра и буферы-векторы
+ * результатов переиспользуются, новых задач цикл не добавляет. Итерация
+ * выполняет тело целиком, включая задачи, от которых выход не зависит. Состояние
+ * может быть структурой или кортежем. FixedPoint — callable S(const S&),
+ * поэтому в родительском графе цикл — одна задача.
+ */
+template<typename S>
+class FixedPoint {
+public:
+  struct Outcome {
+    S value;            ///< последнее состояние
+    size_t iterations;  ///< выполненные итерации тела
+    bool converged;     ///< done сработал до исчерпания maxIterations
+  };
+
+  template<typename Build, typename Done>
+  FixedPoint(Build&& build, Done&& done, size_t maxIterations)
+    : step(std::forward<Build>(build)), isDone(std::forward<Done>(done)), maxIterations(maxIterations) {}
+
+  S operator()(const S& initial) const { return run(initial).value; }
+
+  /// Пул буферов тела (см. Subgraph::bufferStats): результаты итерации возвращаются в него при reset.
+  BufferPool::Stats bufferStats() const { return step.bufferStats(); }
+
+  Outcome run(const S& initial) const {
+    TTaskScheduler instance(ThreadPool::current(), step.body->proto);
+    Outcome out{initial, 0, false};
+    instance.instantiate(step.body->proto, std::cref(out.value));
+    while (!out.converged && out.iterations < maxIterations) {
+      if (out.iterations > 0) instance.reset();
+      instance.executeAll();  // после reset все задачи тела в очереди готовых — обход конуса не нужен
+      S next = instance.template getResult<S>(step.body->output);
+      ++out.iterations;
+      out.converged = isDone(out.value, next);
+      out.value = std::move(next);
+    }
+    return out;
+  }
+
+private:
+  Subgraph<S(S)> step;
+  std::function<bool(const S&, const S&)> isDone;
+  size_t maxIterations;
 };
 
 #endif // TASK_SCHEDULER_HPP
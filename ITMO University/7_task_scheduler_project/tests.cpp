@@ -25,11 +25,139 @@
  * 
  * 9) DeepDependencyChain — Глубокая цепочка зависимостей
  * Тестирует корректность работы с длинными цепочками зависимых задач. Проверяется рекурсивное вычисление и кеширование результатов на всех уровнях.
+ *
+ * 10) ExecuteAllRespectsForwardDependencies — Порядок Кана при зависимостях «вперёд»
+ * Потребитель добавлен раньше продюсера; executeAll() по счётчикам зависимостей должен выполнить продюсера первым. Зависимость далеко за следующим id или за пределом числа задач отклоняется в add() с std::out_of_range, не занимая id.
+ *
+ * 11) ExecuteAllAfterLazyResults — executeAll() после частичной ленивой оценки
+ * Уже вычисленные через getResult задачи не выполняются повторно, остальные выполняются ровно один раз.
+ *
+ * 12) ExecuteAllDetectsCycle — Цикл при executeAll()
+ * Задачи из цикла никогда не становятся готовыми, и executeAll() должен выбросить исключение.
+ *
+ * 13) TaskBitsetScans — Поиск по битовому набору статусов
+ * Проверяет поиск следующего установленного/сброшенного бита через границы 64-битных слов и подсчёт битов.
+ *
+ * 14) ExecuteAllIsIncremental — Повторный executeAll() после новых add()
+ * Повторный вызов выполняет только новые задачи; ошибка из-за ещё не добавленной зависимости исчезает, когда её добавляют.
+ *
+ * 15) ParallelQuadraticExample — Квадратное уравнение в параллельном режиме
+ * Та же цепочка, что и в тесте 1, но на пуле потоков: результаты должны совпасть.
+ *
+ * 16) ParallelLazyEvaluation — Ленивая оценка в параллельном режиме
+ * Задачи вне конуса зависимостей цели не выполняются и на пуле потоков.
+ *
+ * 17) ParallelIndependentInputsOverlap — Независимые входы выполняются одновременно
+ * Два входа цели ждут друг друга; это возможно только если они запущены параллельно.
+ *
+ * 18) ParallelExceptionPropagates — Исключение из задачи на пуле потоков
+ * Исключение, брошенное задачей в рабочем потоке, доходит до вызвавшего getResult.
+ *
+ * 19) GetResultsBatch — Пакетное получение результатов
+ * getResults вычисляет объединённый конус один раз, пишет результаты в буфер вызывающего и не трогает лишние задачи.
+ *
+ * 20) GetResultsReportsErrorsOnce — Ошибки пакетного getResults
+ * Разная длина буферов, неизвестный id и неверный тип дают одно исключение на весь вызов.
+ *
+ * 21) ConcurrentAddDuringEvaluation — add() из нескольких потоков во время вычисления
+ * Потоки-продюсеры строят цепочки, пока основной поток вызывает executeAll(); каждая задача выполняется ровно один раз и даёт верный результат.
+ *
+ * 22) BufferPoolSizeClasses — Классы размеров пула буферов
+ * Освобождённый буфер выдаётся повторно для любого размера из своего класса, мелкие буферы пул не хранит.
+ *
+ * 23) ResetRecyclesResultBuffers — reset() и переиспользование буферов результатов
+ * После reset() граф выполняется заново, а задача получает из пула тот же буфер, что и в прошлом прогоне.
+ *
+ * 24) NonConstMemberFunctionCall — Неконстантный метод объекта-аргумента
+ * Аргументы передаются по const-ссылке, но неконстантный метод всё равно вызывается — на копии объекта.
+ *
+ * 25) ThreadCacheReusesBlocks — Поточно-локальный кеш блоков
+ * Освобождённый блок выдаётся повторно для любого размера своего класса; крупные запросы идут мимо кеша.
+ *
+ * 26) ThreadCacheRemoteFrees — Освобождение блока в чужом потоке
+ * Блоки, освобождённые не владельцем, возвращаются владельцу пачкой и снова раздаются им.
+ *
+ * 27) NonDefaultConstructibleArguments — Аргументы без конструктора по умолчанию
+ * Зависимость на такой тип не создаёт лишнего значения; некопируемый аргумент-значение тоже принимается.
+ *
+ * 28) SharedAndBorrowedArguments — Общие и заимствованные аргументы
+ * share(x) даёт всем задачам один экземпляр значения, borrow(x) — ссылку на значение вызывающего; копий не создаётся.
+ *
+ * 29) RematerializeDroppedResults — Пересчёт освобождённых результатов
+ * Результаты пересчитываемых задач освобождаются после последнего потребителя и вычисляются заново (вместе с входами) по требованию; при достаточном бюджете памяти не освобождаются.
+ *
+ * 30) SpeculationRunsOnlyPureTasks — Спекулятивное выполнение чистых задач
+ * Свободные потоки заранее вычисляют чистые задачи из конусов объявленных выходов; нечистые задачи и зависящие от них ждут запроса; выходы, объявленные позже, и задачи, помеченные чистыми после обхода конуса, тоже вычисляются заранее.
+ *
+ * 31) CostModelLearnsAndPersists — Обучение и сохранение модели стоимости
+ * Время и размер результата копятся по видам задач, переживают save/load и включают политику пересчёта по размеру.
+ *
+ * 32) CheapTasksRunInline — Мелкие задачи в координаторе
+ * Задачи, которые по модели стоимости дешевле порога, выполняются вызывающим потоком, а не пулом.
+ *
+ * 33) ExplainEstimatesWithoutRunning — Оценка getResult без выполнения
+ * explain() считает невычисленный конус, время, критический путь, параллелизм и пик памяти по модели стоимости и ничего не запускает.
+ *
+ * 34) LatencyHistogramQuantiles — Логарифмическая гистограмма задержек
+ * Квантили попадают в корзину с ошибкой не больше 12.5%, слияние складывает счётчики.
+ *
+ * 35) LatencySamplingPerKind — Замер задержек по видам задач
+ * При замере каждого события гистограммы выполнения, ожидания в очереди и getResult заполняются по видам; при замере 1 из N событий записей в N раз меньше.
+ *
+ * 36) FootprintByTaskKindAndType — Память результатов по задачам, видам и типам
+ * result_size учитывает буферы контейнеров и специализации пользователя; отчёт отсортирован по убыванию и сходится с stats().residentBytes — и когда размеры досчитываются лениво, и после включения их учёта.
+ *
+ * 37) AllocationTrackingPerTask — Выделения памяти внутри задач
+ * Выделения считаются на потоке, где выполнялась задача, и попадают в stats() и по видам; после прогрева граф на пуле буферов не выделяет ничего (RunsWithoutAllocations).
+ *
+ * 38) MetricsEndpoint — Метрики работающего шедулера по HTTP
+ * metrics() посреди вычисления отдаёт снимок от координатора (задача в полёте), MetricsServer на localhost отдаёт его в форматах Prometheus и JSON; без enableMetrics() metrics() не читает состояние вычисления и отдаёт пустой снимок.
+ *
+ * 39) RandomDagModesAgree — Случайные DAG во всех режимах
+ * Граф random_dag.hpp воспроизводим по seed; последовательный, параллельный, инкрементальный и ленивый прогоны дают эталонные значения всех узлов при разных формах графа. Большие графы — в stress.cpp.
+ *
+ * 40) DeterministicScheduleReplay — Запись и воспроизведение расписания
+ * Записанное на пуле расписание (порядок и поток каждой задачи) воспроизводится в другом шедулере в точности, в том числе после сохранения в файл; randomSchedule с одним seed даёт одно расписание; задачи вне расписания считаются в stats().unplanned.
+ *
+ * 41) SubgraphAsCompositeTask — Подграф как одна задача
+ * Тело Subgraph строится один раз на все экземпляры; в родителе экземпляр — одна задача; внутренние задачи идут параллельно на пуле родителя; вложенные подграфы на маленьком пуле не зависают; исключение из тела доходит до getResult.
+ *
+ * 42) FixedPointNewtonRefinesRoots — Итерации Ньютона без развёртки цепочки
+ * FixedPoint уточняет корни квадратного уравнения из теста 1 до сходимости, число итераций ограничено maxIterations; в родителе цикл — одна задача, тело выполняется заново на тех же задачах; состояние-пара переносится между итерациями; буфер результата тела из g.buffers() переиспользуется от итерации к итерации (bufferStats().hits).
+ *
+ * 43) ParallelAlgorithmsMatchStd — Узлы scan, sort, histogram, partition
+ * Узлы parallel_algorithms.hpp последовательно и на пуле (мелкие куски) совпадают с std::inclusive_scan/exclusive_scan, std::stable_sort (в том числе устойчивость), счётом в цикле и std::stable_partition на пустых, маленьких и больших буферах; исключение из куска доходит до getResult; много узлов на маленьком пуле не зависают.
+ *
+ * 44) GraphCompilerMatchesScheduler — Граф, скомпилированный graphc, против шедулера
+ * quadratic.graph, выполненный в TTaskScheduler через KernelRegistry, и сгенерированный при сборке код (последовательный и с параллельными уровнями, в том числе как одна задача шедулера) дают одинаковые корни; узлы упорядочены топологически; неизвестное ядро, неверный тип, лишний аргумент и цикл в описании дают std::runtime_error с номером строки.
  */
 
 #include "task_scheduler.hpp"
+#include "metrics_server.hpp"
+#include "random_dag.hpp"
+#include "parallel_algorithms.hpp"
+#include "graph_compiler.hpp"
+#include "quadratic_kernels.hpp"
+#include "quadratic_graph.hpp"
+#include "quadratic_parallel_graph.hpp"
 #include <gtest/gtest.h>
 #include <cmath>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <span>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <random>
+#include <sstream>
+
+// Выделения памяти в тестах считаются AllocationCounter (тест 37).
+TASK_SCHEDULER_COUNT_ALLOCATIONS()
 
 // Структура для проверки вызова метода класса
 struct AddNumber {
@@ -215,3 +343,1331 @@ TEST(TaskScheduler, DeepDependencyChain) {
   int r = sched.getResult<int>(id5);
   EXPECT_EQ(r, 5);
 }
+
+// 10) Зависимость «вперёд»: потребитель добавлен до продюсера.
+TEST(TaskScheduler, ExecuteAllRespectsForwardDependencies) {
+  TTaskScheduler sched;
+
+  std::vector<int> order;
+  auto id0 = sched.add([&order](int x) { order.push_back(0); return x * 2; }, sched.getFutureResult<int>(1));
+  auto id1 = sched.add([&order]() { order.push_back(1); return 21; });
+  auto id2 = sched.add([&order](int a, int b) { order.push_back(2); return a + b; },
+                       sched.getFutureResult<int>(id0), sched.getFutureResult<int>(id1));
+
+  sched.executeAll();
+
+  ASSERT_EQ(order.size(), 3u);
+  EXPECT_EQ(order[0], 1);
+  EXPECT_EQ(order[1], 0);
+  EXPECT_EQ(order[2], 2);
+  EXPECT_EQ(sched.getResult<int>(id2), 63);
+
+  auto twice = [](int x) { return x * 2; };
+  EXPECT_THROW(sched.add(twice, sched.getFutureResult<int>(size_t(-1))), std::out_of_range);
+  EXPECT_THROW(sched.add(twice, sched.getFutureResult<int>(1'000'000'000)), std::out_of_range);
+  EXPECT_THROW(sched.add([](int a, int b) { return a + b; }, 1, sched.getFutureResult<int>(size_t(1) << 60)),
+               std::out_of_range);
+  EXPECT_EQ(sched.size(), 3u);
+  EXPECT_EQ(sched.getResult<int>(sched.add(twice, sched.getFutureResult<int>(id2))), 126);
+}
+
+// 11) executeAll() после того, как часть результатов уже получена лениво.
+TEST(TaskScheduler, ExecuteAllAfterLazyResults) {
+  TTaskScheduler sched;
+
+  int c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+
+  auto id0 = sched.add([&]() { ++c0; return 2; });
+  auto id1 = sched.add([&](int x) { ++c1; return x + 1; }, sched.getFutureResult<int>(id0));
+  auto id2 = sched.add([&](int x) { ++c2; return x * 3; }, sched.getFutureResult<int>(id0));
+  auto id3 = sched.add([&](int a, int b) { ++c3; return a * b; },
+                       sched.getFutureResult<int>(id1), sched.getFutureResult<int>(id2));
+
+  EXPECT_EQ(sched.getResult<int>(id1), 3);
+  EXPECT_EQ(c2, 0);
+
+  sched.executeAll();
+
+  EXPECT_EQ(c0, 1);
+  EXPECT_EQ(c1, 1);
+  EXPECT_EQ(c2, 1);
+  EXPECT_EQ(c3, 1);
+  EXPECT_EQ(sched.getResult<int>(id3), 18);
+}
+
+// 12) Цикл обнаруживается и при executeAll().
+TEST(TaskScheduler, ExecuteAllDetectsCycle) {
+  TTaskScheduler sched;
+
+  sched.add([]() { return 1; });
+  sched.add([](int x) { return x + 1; }, sched.getFutureResult<int>(2));
+  sched.add([](int x) { return x + 2; }, sched.getFutureResult<int>(1));
+
+  EXPECT_THROW(sched.executeAll(), std::runtime_error);
+}
+
+// 13) Поиск по словам в TaskBitset, включая хвост последнего слова.
+TEST(TaskScheduler, TaskBitsetScans) {
+  TaskBitset bits;
+  bits.resize(300);
+
+  EXPECT_EQ(bits.findNextSet(0), 300u);
+  EXPECT_EQ(bits.findNextUnset(0), 0u);
+
+  for (size_t i = 0; i < 300; ++i) {
+    if (i != 5 && i != 130 && i != 299) bits.set(i);
+  }
+  EXPECT_EQ(bits.count(), 297u);
+  EXPECT_EQ(bits.findNextUnset(0), 5u);
+  EXPECT_EQ(bits.findNextUnset(6), 130u);
+  EXPECT_EQ(bits.findNextUnset(131), 299u);
+  EXPECT_EQ(bits.findNextSet(5), 6u);
+
+  bits.set(299);
+  EXPECT_EQ(bits.findNextUnset(131), 300u);
+
+  bits.clear();
+  EXPECT_EQ(bits.count(), 0u);
+  bits.set(257);
+  EXPECT_EQ(bits.findNextSet(1), 257u);
+}
+
+// 14) executeAll() вызывается после каждой небольшой порции add().
+TEST(TaskScheduler, ExecuteAllIsIncremental) {
+  TTaskScheduler sched;
+
+  int runs = 0;
+  auto id0 = sched.add([&runs]() { ++runs; return 1; });
+  auto id1 = sched.add([&runs](int x) { ++runs; return x + 1; }, sched.getFutureResult<int>(id0));
+  sched.executeAll();
+  EXPECT_EQ(runs, 2);
+
+  auto id2 = sched.add([&runs](int a, int b) { ++runs; return a + b; },
+                       sched.getFutureResult<int>(id0), sched.getFutureResult<int>(id1));
+  sched.executeAll();
+  EXPECT_EQ(runs, 3);
+
+  // Зависимость на ещё не добавленную задачу: executeAll() сообщает об ошибке...
+  auto id3 = sched.add([&runs](int x) { ++runs; return x * 10; }, sched.getFutureResult<int>(4));
+  EXPECT_THROW(sched.executeAll(), std::out_of_range);
+
+  // ...и досчитывает граф, как только она появляется.
+  sched.add([&runs](int x) { ++runs; return x + 4; }, sched.getFutureResult<int>(id2));
+  sched.executeAll();
+  EXPECT_EQ(runs, 5);
+  EXPECT_EQ(sched.getResult<int>(id3), 70);
+
+  sched.executeAll();
+  EXPECT_EQ(runs, 5);
+}
+
+// 15) Квадратное уравнение на пуле потоков.
+TEST(TaskScheduler, ParallelQuadraticExample) {
+  TTaskScheduler sched(4);
+  ASSERT_TRUE(sched.isParallel());
+
+  float a = 1.0f;
+  float b = -2.0f;
+  float c = 1.0f;
+  AddNumber ad{3.0f};
+
+  auto id1 = sched.add([](float a, float c) { return -4.0f * a * c; }, a, c);
+  auto id2 = sched.add([](float b, float v) { return b * b + v; }, b, sched.getFutureResult<float>(id1));
+  auto id3 = sched.add([](float b, float d) { return -b + std::sqrt(d); }, b, sched.getFutureResult<float>(id2));
+  auto id4 = sched.add([](float b, float d) { return -b - std::sqrt(d); }, b, sched.getFutureResult<float>(id2));
+  auto id5 = sched.add([](float a, float v) { return v / (2.0f * a); }, a, sched.getFutureResult<float>(id3));
+  auto id6 = sched.add([](float a, float v) { return v / (2.0f * a); }, a, sched.getFutureResult<float>(id4));
+  auto id7 = sched.add(&AddNumber::add, ad, sched.getFutureResult<float>(id6));
+
+  EXPECT_NEAR(sched.getResult<float>(id5), 1.0f, 1e-6f);
+  EXPECT_NEAR(sched.getResult<float>(id6), 1.0f, 1e-6f);
+  EXPECT_NEAR(sched.getResult<float>(id7), 4.0f, 1e-6f);
+}
+
+// 16) Ленивая оценка на пуле потоков.
+TEST(TaskScheduler, ParallelLazyEvaluation) {
+  TTaskScheduler sched(4);
+
+  std::atomic<int> counter{0};
+  auto id0 = sched.add([&counter]() { ++counter; return 10; });
+  auto id1 = sched.add([&counter]() { ++counter; return 20; });
+  auto id2 = sched.add([](int a, int b) { return a + b; },
+                       sched.getFutureResult<int>(id0), sched.getFutureResult<int>(id1));
+  sched.add([&counter]() { // не должен выполниться
+    ++counter;
+    return 100;
+  });
+
+  EXPECT_EQ(sched.getResult<int>(id2), 30);
+  EXPECT_EQ(counter.load(), 2);
+}
+
+// 17) Два тяжёлых независимых входа выполняются одновременно.
+TEST(TaskScheduler, ParallelIndependentInputsOverlap) {
+  TTaskScheduler sched(2);
+
+  std::atomic<int> started{0};
+  auto waitForBoth = [&started]() {
+    ++started;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (started.load() < 2 && std::chrono::steady_clock::now() < deadline) std::this_thread::yield();
+    return started.load() == 2;
+  };
+
+  auto id0 = sched.add(waitForBoth);
+  auto id1 = sched.add(waitForBoth);
+  auto id2 = sched.add([](bool a, bool b) { return a && b; },
+                       sched.getFutureResult<bool>(id0), sched.getFutureResult<bool>(id1));
+
+  EXPECT_TRUE(sched.getResult<bool>(id2));
+}
+
+// 18) Исключение из рабочего потока передаётся вызывающему.
+TEST(TaskScheduler, ParallelExceptionPropagates) {
+  TTaskScheduler sched(2);
+
+  auto id0 = sched.add([]() -> int { throw std::logic_error("boom"); });
+  auto id1 = sched.add([](int x) { return x + 1; }, sched.getFutureResult<int>(id0));
+  auto id2 = sched.add([]() { return 5; });
+
+  EXPECT_THROW(sched.getResult<int>(id1), std::logic_error);
+  EXPECT_EQ(sched.getResult<int>(id2), 5);
+  EXPECT_THROW(sched.executeAll(), std::logic_error);
+}
+
+// 19) Пакетный getResults по нескольким id, в том числе повторяющимся.
+TEST(TaskScheduler, GetResultsBatch) {
+  for (size_t threads : {0, 3}) {
+    TTaskScheduler sched(threads);
+
+    std::atomic<int> runs{0};
+    auto base = sched.add([&runs]() { ++runs; return 1; });
+    std::vector<size_t> ids;
+    for (int k = 0; k < 8; ++k) {
+      ids.push_back(sched.add([&runs](int b, int k) { ++runs; return b + k; }, sched.getFutureResult<int>(base), k));
+    }
+    sched.add([&runs]() { ++runs; return 0; }); // не запрашивается — не должна выполниться
+
+    EXPECT_EQ(sched.getResult<int>(ids[3]), 4);
+    ids.push_back(ids[0]);
+
+    std::vector<int> out(ids.size(), -1);
+    sched.getResults<int>(ids, out);
+
+    for (int k = 0; k < 8; ++k) EXPECT_EQ(out[k], 1 + k);
+    EXPECT_EQ(out[8], 1);
+    EXPECT_EQ(runs.load(), 9);
+  }
+}
+
+// 20) Ошибки getResults сообщаются одним исключением на вызов.
+TEST(TaskScheduler, GetResultsReportsErrorsOnce) {
+  TTaskScheduler sched;
+
+  auto id0 = sched.add([]() { return 1; });
+  auto id1 = sched.add([]() { return 2.5f; });
+
+  std::vector<int> out(2, -1);
+  std::vector<size_t> ids = {id0, id1};
+  EXPECT_THROW(sched.getResults<int>(ids, std::span<int>(out.data(), 1)), std::invalid_argument);
+  EXPECT_THROW(sched.getResults<int>(ids, out), std::runtime_error);
+
+  std::vector<size_t> bad = {id0, 42};
+  EXPECT_THROW(sched.getResults<int>(bad, out), std::out_of_range);
+}
+
+// 21) Продюсеры расширяют граф, пока основной поток его вычисляет.
+TEST(TaskScheduler, ConcurrentAddDuringEvaluation) {
+  for (size_t threads : {0, 2}) {
+    TTaskScheduler sched(threads);
+
+    constexpr int kProducers = 4;
+    constexpr int kChain = 2000;
+    std::atomic<int> runs{0};
+    std::atomic<int> finished{0};
+    std::vector<std::vector<size_t>> ids(kProducers);
+    std::vector<std::thread> producers;
+
+    for (int p = 0; p < kProducers; ++p) {
+      producers.emplace_back([&, p]() {
+        size_t prev = sched.add([&runs, p]() { ++runs; return p; });
+        ids[p].push_back(prev);
+        for (int k = 1; k < kChain; ++k) {
+          prev = sched.add([&runs](int x) { ++runs; return x + 1; }, sched.getFutureResult<int>(prev));
+          ids[p].push_back(prev);
+        }
+        ++finished;
+      });
+    }
+
+    while (finished.load() < kProducers) sched.executeAll();
+    for (auto& t : producers) t.join();
+    sched.executeAll();
+
+    EXPECT_EQ(sched.size(), static_cast<size_t>(kProducers * kChain));
+    EXPECT_EQ(runs.load(), kProducers * kChain);
+    for (int p = 0; p < kProducers; ++p) {
+      for (int k = 0; k < kChain; k += 97) EXPECT_EQ(sched.getResult<int>(ids[p][k]), p + k);
+    }
+  }
+}
+
+// 22) Пул буферов: классы размеров и порог минимального размера.
+TEST(TaskScheduler, BufferPoolSizeClasses) {
+  BufferPool pool;
+
+  std::vector<double> a = pool.acquire<double>(3000);
+  EXPECT_EQ(a.size(), 3000u);
+  const double* data = a.data();
+  pool.release(std::move(a));
+  EXPECT_EQ(pool.stats().retainedBytes, 4096 * sizeof(double));
+
+  std::vector<double> b = pool.acquire<double>(4000);  // тот же класс 2^12
+  EXPECT_EQ(b.data(), data);
+  EXPECT_EQ(pool.stats().hits, 1u);
+
+  std::vector<float> c = pool.acquire<float>(4000);  // другой тип — другой буфер
+  EXPECT_NE(static_cast<const void*>(c.data()), static_cast<const void*>(data));
+  EXPECT_EQ(pool.stats().misses, 2u);
+
+  pool.release(std::vector<int>(16));
+  EXPECT_EQ(pool.stats().retainedBytes, 0u);
+}
+
+// 23) reset() возвращает буферы результатов в пул, и следующий прогон их переиспользует.
+TEST(TaskScheduler, ResetRecyclesResultBuffers) {
+  TTaskScheduler sched;
+
+  int runs = 0;
+  const int* seen = nullptr;
+  auto produce = sched.add([&](BufferHandle pool, size_t n) {
+    ++runs;
+    std::vector<int> v = pool.acquire<int>(n);
+    for (size_t i = 0; i < n; ++i) v[i] = static_cast<int>(i);
+    seen = v.data();
+    return v;
+  }, sched.buffers(), size_t(10000));
+  auto sum = sched.add([](const std::vector<int>& v) {
+    long long s = 0;
+    for (int x : v) s += x;
+    return s;
+  }, sched.getFutureResult<std::vector<int>>(produce));
+
+  EXPECT_EQ(sched.getResult<long long>(sum), 49995000LL);
+  const int* first = seen;
+
+  sched.reset();
+  EXPECT_EQ(sched.bufferStats().retainedBytes, 16384 * sizeof(int));
+
+  EXPECT_EQ(sched.getResult<long long>(sum), 49995000LL);
+  EXPECT_EQ(runs, 2);
+  EXPECT_EQ(seen, first);
+  EXPECT_EQ(sched.bufferStats().hits, 1u);
+}
+
+// 24) Неконстантный метод вызывается на копии объекта-аргумента.
+TEST(TaskScheduler, NonConstMemberFunctionCall) {
+  TTaskScheduler sched;
+
+  struct Counter {
+    int value;
+    int bump(int x) { value += x; return value; }
+  };
+
+  Counter counter{1};
+  auto id0 = sched.add([]() { return 41; });
+  auto id1 = sched.add(&Counter::bump, counter, sched.getFutureResult<int>(id0));
+
+  EXPECT_EQ(sched.getResult<int>(id1), 42);
+  EXPECT_EQ(counter.value, 1);
+}
+
+// 25) Повторная выдача блока из поточно-локального кеша.
+TEST(TaskScheduler, ThreadCacheReusesBlocks) {
+  void* a = ThreadCache::allocate(40);
+  ThreadCache::deallocate(a);
+  void* b = ThreadCache::allocate(64);
+  EXPECT_EQ(a, b);
+  ThreadCache::deallocate(b);
+
+  std::vector<int, CachedAllocator<int>> scratch(8, 7);
+  EXPECT_EQ(scratch[7], 7);
+
+  void* big = ThreadCache::allocate(ThreadCache::kMaxBlock + 1);
+  ThreadCache::deallocate(big);
+}
+
+// 26) Чужие освобождения возвращаются владельцу и переиспользуются им.
+TEST(TaskScheduler, ThreadCacheRemoteFrees) {
+  std::vector<void*> blocks;
+  std::atomic<int> stage{0};
+  size_t reclaimed = 0;
+  bool reused = false;
+
+  // Кеш потока может достаться от завершённого потока вместе с его ожидающими освобождениями.
+  ThreadCache::flushRemoteFrees();
+  std::thread owner([&] {
+    ThreadCache::local().reclaimRemote();
+    for (int i = 0; i < 10; ++i) blocks.push_back(ThreadCache::allocate(100));
+    stage = 1;
+    while (stage != 2) std::this_thread::yield();
+    reclaimed = ThreadCache::local().reclaimRemote();
+    void* again = ThreadCache::allocate(100);
+    reused = std::find(blocks.begin(), blocks.end(), again) != blocks.end();
+    ThreadCache::deallocate(again);
+  });
+
+  while (stage != 1) std::this_thread::yield();
+  for (void* p : blocks) ThreadCache::deallocate(p);
+  ThreadCache::flushRemoteFrees();
+  stage = 2;
+  owner.join();
+
+  EXPECT_EQ(reclaimed, 10u);
+  EXPECT_TRUE(reused);
+}
+
+// 27) Типы без конструктора по умолчанию и некопируемые аргументы.
+TEST(TaskScheduler, NonDefaultConstructibleArguments) {
+  TTaskScheduler sched;
+
+  struct Meters {
+    explicit Meters(double v) : value(v) {}
+    double value;
+  };
+
+  auto id0 = sched.add([](double x) { return Meters(x); }, 2.5);
+  auto id1 = sched.add([](const Meters& a, const Meters& b) { return a.value * b.value; },
+                       sched.getFutureResult<Meters>(id0), Meters(4.0));
+  auto id2 = sched.add([](const std::unique_ptr<int>& p, double k) { return *p * k; },
+                       std::make_unique<int>(3), sched.getFutureResult<double>(id1));
+
+  EXPECT_DOUBLE_EQ(sched.getResult<double>(id1), 10.0);
+  EXPECT_DOUBLE_EQ(sched.getResult<double>(id2), 30.0);
+}
+
+// 28) share() и borrow(): одна копия значения на все задачи.
+TEST(TaskScheduler, SharedAndBorrowedArguments) {
+  TTaskScheduler sched;
+
+  auto table = share(std::vector<int>(1000, 2));
+  const std::vector<int> local(10, 5);
+
+  std::vector<const int*> seen;
+  std::vector<size_t> ids;
+  for (int i = 0; i < 4; ++i) {
+    ids.push_back(sched.add([&seen](const std::vector<int>& t, int k) {
+      seen.push_back(t.data());
+      return t[static_cast<size_t>(k)] * k;
+    }, table, i));
+  }
+  auto viaBorrow = sched.add([&seen](const std::vector<int>& v, const std::vector<int>& t) {
+    seen.push_back(v.data());
+    return static_cast<int>(v.size() + t.size());
+  }, borrow(local), table);
+
+  EXPECT_EQ(sched.getResult<int>(ids[3]), 6);
+  sched.executeAll();
+  EXPECT_EQ(sched.getResult<int>(viaBorrow), 1010);
+
+  ASSERT_EQ(seen.size(), 5u);
+  for (size_t i = 0; i < 4; ++i) EXPECT_EQ(seen[i], table.ptr->data());
+  EXPECT_EQ(seen[4], local.data());
+  EXPECT_EQ(table.ptr.use_count(), 6);
+}
+
+// 29) Освобождение и ленивый пересчёт результатов.
+TEST(TaskScheduler, RematerializeDroppedResults) {
+  TTaskScheduler sched;
+  int runsA = 0, runsB = 0;
+
+  auto a = sched.add([&runsA] { ++runsA; return std::vector<int>(1000, 1); });
+  auto b = sched.add([&runsB](const std::vector<int>& v) { ++runsB; return std::vector<int>(v.size(), v[0] + 1); },
+                     sched.getFutureResult<std::vector<int>>(a));
+  auto c = sched.add([](const std::vector<int>& v) { return v[0] * static_cast<int>(v.size()); },
+                     sched.getFutureResult<std::vector<int>>(b));
+  sched.markRematerializable(a);
+  sched.markRematerializable(b);
+
+  EXPECT_EQ(sched.getResult<int>(c), 2000);
+  EXPECT_EQ(sched.stats().dropped, 2u);
+  EXPECT_EQ(sched.stats().recomputes, 0u);
+  EXPECT_LT(sched.stats().residentBytes, 1000 * sizeof(int));
+
+  // Потребитель, добавленный после освобождения, пересчитывает b и его вход a.
+  auto d = sched.add([](const std::vector<int>& v) { return v[999]; }, sched.getFutureResult<std::vector<int>>(b));
+  EXPECT_EQ(sched.getResult<int>(d), 2);
+  EXPECT_EQ(runsA, 2);
+  EXPECT_EQ(runsB, 2);
+  EXPECT_EQ(sched.stats().recomputes, 2u);
+
+  EXPECT_EQ(sched.getResult<std::vector<int>>(a).size(), 1000u);
+  EXPECT_EQ(runsA, 3);
+  EXPECT_EQ(sched.stats().executions, 4u);
+
+  // С бюджетом, вмещающим все результаты, ничего не освобождается.
+  const size_t droppedBefore = sched.stats().dropped;
+  sched.reset();
+  sched.setMemoryBudget(size_t(1) << 20);
+  sched.executeAll();
+  EXPECT_EQ(sched.stats().dropped, droppedBefore);
+  EXPECT_EQ(runsA, 4);
+  EXPECT_EQ(sched.getResult<int>(d), 2);
+  EXPECT_EQ(runsA, 4);
+}
+
+// 30) Спекуляция выполняет только чистые задачи конусов объявленных выходов.
+TEST(TaskScheduler, SpeculationRunsOnlyPureTasks) {
+  TTaskScheduler sched(2);
+  std::atomic<int> runsA{0}, runsB{0}, runsC{0}, runsD{0}, runsE{0};
+
+  auto a = sched.add([&] { ++runsA; return 20; });
+  auto b = sched.add([&] { ++runsB; return 1; });
+  auto c = sched.add([&](int x) { ++runsC; return x + 1; }, sched.getFutureResult<int>(a));
+  auto d = sched.add([&](int x) { ++runsD; return x * 2; }, sched.getFutureResult<int>(b));
+  auto e = sched.add([&] { ++runsE; return 5; });
+  for (size_t id : {a, c, d, e}) sched.markPure(id);
+  sched.declareOutput(c);
+  sched.declareOutput(d);
+  sched.enableSpeculation();
+
+  auto waitSpeculated = [&](size_t n) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (sched.stats().speculated < n && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  };
+  waitSpeculated(2);
+
+  EXPECT_EQ(sched.stats().speculated, 2u);
+  EXPECT_EQ(runsA, 1);
+  EXPECT_EQ(runsC, 1);
+  EXPECT_EQ(runsB, 0);  // нечистая
+  EXPECT_EQ(runsD, 0);  // ждёт нечистый вход
+  EXPECT_EQ(runsE, 0);  // чистая, но не в конусе выходов
+
+  EXPECT_EQ(sched.getResult<int>(c), 21);
+  EXPECT_EQ(runsC, 1);
+  EXPECT_EQ(sched.getResult<int>(d), 2);
+  EXPECT_EQ(runsB, 1);
+  EXPECT_EQ(runsD, 1);
+
+  // Конусы дорастают после первого обхода: новый выход над вычисленной c и
+  // задача, помеченная чистой уже после того, как её конус обойдён.
+  std::atomic<int> runsF{0}, runsG{0};
+  auto f = sched.add([&](int x) { ++runsF; return x * 10; }, sched.getFutureResult<int>(c));
+  sched.markPure(f);
+  sched.declareOutput(f);
+  auto g = sched.add([&](int x) { ++runsG; return x + 1; }, sched.getFutureResult<int>(e));
+  sched.declareOutput(g);
+  sched.markPure(g);
+  waitSpeculated(5);
+  EXPECT_EQ(sched.stats().speculated, 5u);  // + f, e, g
+  EXPECT_EQ(runsF, 1);
+  EXPECT_EQ(runsE, 1);
+  EXPECT_EQ(runsG, 1);
+  EXPECT_EQ(sched.getResult<int>(g), 6);
+}
+
+// 31) Модель стоимости: обучение, сохранение в файл и политика пересчёта.
+TEST(TaskScheduler, CostModelLearnsAndPersists) {
+  TTaskScheduler sched;
+  sched.learnCosts();
+
+  auto slow = sched.add([] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    return 1;
+  });
+  sched.setKind(slow, "test.slow");
+  std::vector<size_t> sums;
+  for (int i = 0; i < 3; ++i) {
+    auto big = sched.add([](int x) { return std::vector<int>(1000, x); }, sched.getFutureResult<int>(slow));
+    sched.setKind(big, "test.big");
+    sums.push_back(sched.add([](const std::vector<int>& v) { return v.size(); },
+                             sched.getFutureResult<std::vector<int>>(big)));
+  }
+  sched.executeAll();
+
+  const auto slowStats = sched.costModel().stats("test.slow");
+  const auto bigStats = sched.costModel().stats("test.big");
+  EXPECT_EQ(slowStats.count, 1u);
+  EXPECT_GE(slowStats.meanNs, 2e6);
+  EXPECT_GE(slowStats.p99Ns, 2'000'000u);
+  EXPECT_EQ(bigStats.count, 3u);
+  EXPECT_GE(bigStats.meanBytes, 4000.0);
+  EXPECT_EQ(sched.stats().dropped, 0u);
+
+  const std::string path = testing::TempDir() + "task_scheduler_costs.txt";
+  sched.costModel().save(path);
+  CostModel restored;
+  EXPECT_FALSE(restored.load(path + ".missing"));
+  ASSERT_TRUE(restored.load(path));
+  EXPECT_EQ(restored.stats("test.big").count, 3u);
+  EXPECT_DOUBLE_EQ(restored.stats("test.slow").meanNs, slowStats.meanNs);
+  std::remove(path.c_str());
+
+  // Большие и дешёвые по модели результаты освобождаются после потребителей.
+  sched.reset();
+  sched.setRematerializePolicy(4000, 1e9);
+  sched.executeAll();
+  EXPECT_EQ(sched.stats().dropped, 3u);
+  EXPECT_EQ(sched.getResult<size_t>(sums[0]), 1000u);
+}
+
+// 32) Дешёвые по модели задачи выполняются координатором, а не пулом.
+TEST(TaskScheduler, CheapTasksRunInline) {
+  TTaskScheduler sched(2);
+  std::vector<std::thread::id> where(3);
+
+  auto a = sched.add([&where] { where[0] = std::this_thread::get_id(); return 1; });
+  auto b = sched.add([&where](int x) { where[1] = std::this_thread::get_id(); return x + 1; },
+                     sched.getFutureResult<int>(a));
+  auto c = sched.add([&where](int x) { where[2] = std::this_thread::get_id(); return x * 3; },
+                     sched.getFutureResult<int>(b));
+  sched.setKind(a, "test.tiny");
+  sched.setKind(b, "test.tiny");
+  sched.setKind(c, "test.tiny");
+
+  EXPECT_EQ(sched.getResult<int>(c), 6);
+  for (const auto& id : where) EXPECT_NE(id, std::this_thread::get_id());
+
+  // Модель, как после загрузки из файла: задачи этого вида стоят ~100 нс.
+  for (int i = 0; i < 100; ++i) sched.costModel().record(CostModel::kindOf("test.tiny"), 100, sizeof(int));
+  sched.reset();
+  EXPECT_EQ(sched.getResult<int>(c), 6);
+  for (const auto& id : where) EXPECT_EQ(id, std::this_thread::get_id());
+}
+
+// 33) explain(): оценки по модели стоимости без выполнения задач.
+TEST(TaskScheduler, ExplainEstimatesWithoutRunning) {
+  TTaskScheduler sched;
+  int runs = 0;
+  CostModel& model = sched.costModel();
+  for (int i = 0; i < 10; ++i) {
+    model.record(CostModel::kindOf("explain.heavy"), 1'000'000, 1000);
+    model.record(CostModel::kindOf("explain.join"), 100, 8);
+  }
+
+  auto a = sched.add([&runs] { ++runs; return 1.0; });
+  auto b = sched.add([&runs] { ++runs; return 2.0; });
+  auto c = sched.add([&runs](double x, double y) { ++runs; return x + y; },
+                     sched.getFutureResult<double>(a), sched.getFutureResult<double>(b));
+  auto d = sched.add([&runs](double x) { ++runs; return x; }, sched.getFutureResult<double>(c));
+  sched.setKind(a, "explain.heavy");
+  sched.setKind(b, "explain.heavy");
+  sched.setKind(c, "explain.join");
+
+  auto e = sched.explain(c);
+  EXPECT_EQ(e.unevaluated, 3u);
+  EXPECT_EQ(e.unestimated, 0u);
+  EXPECT_DOUBLE_EQ(e.cpuNs, 2'000'100.0);
+  EXPECT_DOUBLE_EQ(e.criticalPathNs, 1'000'100.0);
+  EXPECT_NEAR(e.parallelism, 2.0, 1e-3);
+  EXPECT_EQ(e.peakBytes, 2008u);
+  EXPECT_EQ(runs, 0);
+
+  EXPECT_EQ(sched.explain(d).unestimated, 1u);
+
+  sched.getResult<double>(a);
+  e = sched.explain(c);
+  EXPECT_EQ(e.unevaluated, 2u);
+  EXPECT_DOUBLE_EQ(e.cpuNs, 1'000'100.0);
+  EXPECT_EQ(runs, 1);
+
+  EXPECT_THROW(sched.explain(100), std::out_of_range);
+  auto loop = sched.add([](int x) { return x; }, sched.getFutureResult<int>(sched.size() + 1));
+  sched.add([](int x) { return x; }, sched.getFutureResult<int>(loop));
+  EXPECT_THROW(sched.explain(loop), std::runtime_error);
+}
+
+// 34) Квантили и слияние LatencyHistogram.
+TEST(TaskScheduler, LatencyHistogramQuantiles) {
+  LatencyHistogram a, b;
+  for (uint64_t v = 1; v <= 1000; ++v) a.record(v * 1000);
+  b.record(5'000'000);
+
+  const auto s = a.summary();
+  EXPECT_EQ(s.count, 1000u);
+  EXPECT_GE(s.p50, 500'000u);
+  EXPECT_LE(s.p50, 500'000u * 9 / 8);
+  EXPECT_GE(s.p99, 990'000u);
+  EXPECT_LE(s.p999, 1'000'000u);
+  EXPECT_EQ(s.max, 1'000'000u);
+
+  a.merge(b);
+  EXPECT_EQ(a.count(), 1001u);
+  EXPECT_EQ(a.quantile(1.0), 5'000'000u);
+  for (uint64_t v : {0ull, 15ull, 16ull, 17ull, 1ull << 40, ~0ull}) {
+    EXPECT_GE(LatencyHistogram::upperBound(LatencyHistogram::index(v)), v);
+  }
+}
+
+// 35) Гистограммы выполнения, ожидания в очереди и getResult по видам задач.
+TEST(TaskScheduler, LatencySamplingPerKind) {
+  TTaskScheduler sched(2);
+  sched.setLatencySampling(1);
+
+  std::vector<size_t> ids;
+  for (int i = 0; i < 4; ++i) {
+    ids.push_back(sched.add([i] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      return i;
+    }));
+    sched.setKind(ids.back(), "latency.sleep");
+  }
+  for (size_t id : ids) sched.getResult<int>(id);
+
+  const auto l = sched.latency("latency.sleep");
+  EXPECT_EQ(l.execution.count(), 4u);
+  EXPECT_EQ(l.queueWait.count(), 4u);
+  EXPECT_EQ(l.request.count(), 4u);
+  EXPECT_GE(l.execution.summary().p50, 2'000'000u);
+  EXPECT_GE(l.request.summary().p99, l.execution.summary().p50);
+  EXPECT_EQ(sched.latencyTotal().execution.count(), 4u);
+
+  TTaskScheduler sampled;
+  sampled.setLatencySampling(4);
+  size_t prev = sampled.add([] { return 0; });
+  sampled.setKind(prev, "latency.chain");
+  for (int i = 1; i < 64; ++i) {
+    prev = sampled.add([](int x) { return x + 1; }, sampled.getFutureResult<int>(prev));
+    sampled.setKind(prev, "latency.chain");
+  }
+  sampled.executeAll();
+  EXPECT_EQ(sampled.latency("latency.chain").execution.count(), 16u);
+}
+
+// Тип, владеющий памятью вне sizeof: размер сообщает специализация result_size.
+struct Blob {
+  std::shared_ptr<char[]> data;
+  size_t len = 0;
+};
+
+template<>
+struct result_size<Blob> {
+  static size_t bytes(const Blob& b) { return sizeof(Blob) + b.len; }
+};
+
+// 36) Отчёт footprint(): кто держит память хранимых результатов.
+TEST(TaskScheduler, FootprintByTaskKindAndType) {
+  EXPECT_EQ(result_size<int>::bytes(1), sizeof(int));
+  std::vector<int> v;
+  v.reserve(100);
+  EXPECT_EQ(result_size<std::vector<int>>::bytes(v), sizeof(v) + 100 * sizeof(int));
+  std::vector<std::vector<int>> nested(2, std::vector<int>(10));
+  EXPECT_GE(result_size<decltype(nested)>::bytes(nested), sizeof(nested) + 2 * sizeof(std::vector<int>) + 20 * sizeof(int));
+
+  TTaskScheduler sched;
+  const size_t big = sched.add([] { return Blob{std::shared_ptr<char[]>(new char[1 << 20]), 1 << 20}; });
+  sched.setKind(big, "footprint.blob");
+  for (int i = 0; i < 3; ++i) {
+    const size_t id = sched.add([i] { return std::vector<int>(1000 * (i + 1)); });
+    sched.setKind(id, "footprint.vector");
+  }
+  const size_t small = sched.add([] { return 42; });
+  sched.executeAll();
+
+  const auto f = sched.footprint(2);
+  EXPECT_EQ(f.totalBytes, sched.stats().residentBytes);
+  ASSERT_EQ(f.tasks.size(), 2u);
+  EXPECT_EQ(f.tasks[0].first, big);
+  EXPECT_EQ(f.tasks[0].second, sizeof(Blob) + (1u << 20));
+  EXPECT_EQ(f.tasks[1].second, sizeof(std::vector<int>) + 3000 * sizeof(int));
+
+  ASSERT_GE(f.byKind.size(), 3u);
+  EXPECT_EQ(f.byKind[0].name, "footprint.blob");
+  EXPECT_EQ(f.byKind[1].name, "footprint.vector");
+  EXPECT_EQ(f.byKind[1].count, 3u);
+  ASSERT_EQ(f.byType.size(), 3u);
+  EXPECT_NE(f.byType[0].name.find("Blob"), std::string::npos);
+  EXPECT_NE(f.byType[1].name.find("vector"), std::string::npos);
+  EXPECT_EQ(f.byType[2].name, "int");
+  EXPECT_EQ(f.byType[2].bytes, sizeof(int));
+  EXPECT_EQ(sched.getResult<int>(small), 42);
+
+  // Размеры досчитаны лениво; включение учёта (здесь — обучением) даёт те же байты.
+  sched.learnCosts();
+  EXPECT_EQ(sched.stats().residentBytes, f.totalBytes);
+  EXPECT_EQ(sched.footprint(2).tasks, f.tasks);
+}
+
+/**
+ * Прогоняет граф дважды (между прогонами — reset()) и проверяет, что во втором,
+ * установившемся, прогоне задачи не сделали ни одного выделения памяти.
+ * При неудаче перечисляет виды задач, которые выделяли.
+ */
+::testing::AssertionResult RunsWithoutAllocations(TTaskScheduler& sched, const std::function<void()>& run) {
+  sched.setAllocationTracking(true);
+  run();  // прогрев: кеш потока, пул буферов
+  sched.reset();
+  std::map<std::string, uint64_t> before;
+  for (const auto& [kind, c] : sched.allocationsByKind()) before[kind] = c.allocations;
+  const uint64_t total = sched.stats().allocations;
+  run();
+  sched.setAllocationTracking(false);
+  if (sched.stats().allocations == total) return ::testing::AssertionSuccess();
+
+  auto failure = ::testing::AssertionFailure()
+      << (sched.stats().allocations - total) << " allocations in steady state:";
+  for (const auto& [kind, c] : sched.allocationsByKind()) {
+    if (c.allocations != before[kind]) failure << "\n  " << kind << ": " << (c.allocations - before[kind]);
+  }
+  return failure;
+}
+
+// 37) Атрибуция выделений памяти задачам.
+TEST(TaskScheduler, AllocationTrackingPerTask) {
+  ASSERT_TRUE(AllocationCounter::hooked());
+
+  for (size_t threads : {size_t(0), size_t(2)}) {
+    TTaskScheduler sched(threads);
+    sched.setAllocationTracking(true);
+    const size_t vec = sched.add([] { return std::vector<int>(1000); });
+    sched.setKind(vec, "alloc.vector");
+    const size_t str = sched.add([] { return std::string(100, 'x'); });
+    sched.setKind(str, "alloc.string");
+    const size_t sum = sched.add([](const std::vector<int>& v, const std::string& s) {
+      return static_cast<int>(v.size() + s.size());
+    }, sched.getFutureResult<std::vector<int>>(vec), sched.getFutureResult<std::string>(str));
+    sched.setKind(sum, "alloc.none");
+    EXPECT_EQ(sched.getResult<int>(sum), 1100);
+
+    const auto stats = sched.stats();
+    EXPECT_GE(stats.allocations, 2u);
+    EXPECT_GE(stats.allocatedBytes, 1000 * sizeof(int) + 100);
+    // Первое выделение на потоке может взять у ОС регион кеша потока — он тоже
+    // достаётся выделившей задаче, поэтому порядок видов здесь не фиксирован.
+    std::map<std::string, AllocationCounter::Counts> byKind;
+    uint64_t prevBytes = ~0ull;
+    for (const auto& [kind, c] : sched.allocationsByKind()) {
+      EXPECT_LE(c.bytes, prevBytes);
+      prevBytes = c.bytes;
+      byKind[kind] = c;
+    }
+    EXPECT_GE(byKind["alloc.vector"].bytes, 1000 * sizeof(int));
+    EXPECT_GE(byKind["alloc.string"].bytes, 100u);
+    // На пуле задача может попасть на поток с ещё пустым кешем — тогда и она выделяет.
+    if (threads == 0) {
+      EXPECT_EQ(byKind.count("alloc.none"), 0u);
+    }
+  }
+
+  TTaskScheduler sched;
+  size_t prev = sched.add([](BufferHandle pool) {
+    std::vector<int> v = pool.acquire<int>(5000);
+    for (size_t i = 0; i < v.size(); ++i) v[i] = static_cast<int>(i);
+    return v;
+  }, sched.buffers());
+  for (int i = 0; i < 8; ++i) {
+    prev = sched.add([](BufferHandle pool, const std::vector<int>& in) {
+      std::vector<int> v = pool.acquire<int>(in.size());
+      for (size_t j = 0; j < in.size(); ++j) v[j] = in[j] + 1;
+      return v;
+    }, sched.buffers(), sched.getFutureResult<std::vector<int>>(prev));
+  }
+  const size_t total = sched.add([](const std::vector<int>& v) { return v.back(); },
+                                 sched.getFutureResult<std::vector<int>>(prev));
+  EXPECT_TRUE(RunsWithoutAllocations(sched, [&] { sched.getResult<int>(total); }));
+  EXPECT_EQ(sched.getResult<int>(total), 5007);
+
+  TTaskScheduler leaky;
+  const size_t fresh = leaky.add([] { return std::vector<int>(5000); });
+  EXPECT_FALSE(RunsWithoutAllocations(leaky, [&] { leaky.getResult<std::vector<int>>(fresh); }));
+}
+
+// Простейший HTTP-клиент для теста 38: ответ целиком, с заголовками.
+std::string httpGet(uint16_t port, const std::string& path) {
+  const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  std::string response;
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+    const std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ::send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+    char buf[4096];
+    for (ssize_t n; (n = ::recv(fd, buf, sizeof(buf), 0)) > 0;) response.append(buf, static_cast<size_t>(n));
+  }
+  ::close(fd);
+  return response;
+}
+
+// 38) Наблюдение за шедулером во время вычисления и HTTP-точка метрик.
+TEST(TaskScheduler, MetricsEndpoint) {
+  TTaskScheduler sched(2);
+  sched.setLatencySampling(1);
+  MetricsServer server(sched);
+
+  std::atomic<bool> started{false}, release{false};
+  const size_t slow = sched.add([&started, &release] {
+    started = true;
+    while (!release) std::this_thread::yield();
+    return 1;
+  });
+  sched.setKind(slow, "metrics.slow");
+  const size_t vec = sched.add([] { return std::vector<int>(1000); });
+  sched.setKind(vec, "metrics.vector");
+
+  std::thread evaluator([&] { sched.getResult<int>(slow); });
+  while (!started) std::this_thread::yield();
+  const auto live = sched.metrics(std::chrono::seconds(10));
+  EXPECT_TRUE(live->evaluating);
+  EXPECT_EQ(live->inflight, 1u);
+  EXPECT_NE(httpGet(server.port(), "/metrics").find("task_scheduler_inflight_tasks 1\n"), std::string::npos);
+  release = true;
+  evaluator.join();
+  EXPECT_EQ(sched.getResult<std::vector<int>>(vec).size(), 1000u);
+
+  const auto idle = sched.metrics();
+  EXPECT_GT(idle->version, live->version);
+  EXPECT_FALSE(idle->evaluating);
+  EXPECT_EQ(idle->stats.executions, 2u);
+  EXPECT_EQ(idle->footprint.totalBytes, sched.stats().residentBytes);
+
+  const std::string text = httpGet(server.port(), "/metrics");
+  EXPECT_EQ(text.rfind("HTTP/1.1 200 OK", 0), 0u);
+  EXPECT_NE(text.find("task_scheduler_executions_total 2\n"), std::string::npos);
+  EXPECT_NE(text.find("task_scheduler_execution_seconds_count{kind=\"metrics.slow\"} 1\n"), std::string::npos);
+  EXPECT_NE(text.find("task_scheduler_request_seconds{kind=\"metrics.vector\",quantile=\"0.99\"}"), std::string::npos);
+  EXPECT_NE(text.find("task_scheduler_footprint_kind_bytes{kind=\"metrics.vector\"} "), std::string::npos);
+
+  const std::string json = httpGet(server.port(), "/metrics.json");
+  EXPECT_NE(json.find("Content-Type: application/json"), std::string::npos);
+  EXPECT_NE(json.find("\"evaluating\":false"), std::string::npos);
+  EXPECT_NE(json.find("\"executions\":2,"), std::string::npos);
+  EXPECT_NE(json.find("{\"name\":\"metrics.slow\",\"execution\":{\"count\":1,"), std::string::npos);
+
+  EXPECT_EQ(httpGet(server.port(), "/other").rfind("HTTP/1.1 404", 0), 0u);
+
+  TTaskScheduler quiet;
+  quiet.getResult<std::vector<int>>(quiet.add([] { return std::vector<int>(100); }));
+  EXPECT_EQ(quiet.metrics()->version, 0u);
+  EXPECT_EQ(quiet.metrics()->footprint.totalBytes, 0u);
+  EXPECT_EQ(quiet.footprint().totalBytes, quiet.stats().residentBytes);
+}
+
+// 39) Один случайный граф — одинаковые значения во всех режимах выполнения.
+TEST(TaskScheduler, RandomDagModesAgree) {
+  RandomDagConfig base;
+  base.nodes = 20000;
+  base.depth = 100;
+  base.seed = 7;
+  const auto reference = RandomDag(base).evaluate();
+  EXPECT_EQ(RandomDag(base).evaluate(), reference);
+  RandomDagConfig other = base;
+  other.seed = 8;
+  EXPECT_NE(RandomDag(other).evaluate(), reference);
+
+  RandomDagConfig wide = base;
+  wide.depth = 4;
+  wide.fanIn = 2;
+  RandomDagConfig hubs = base;
+  hubs.fanOutSkew = 8;
+  hubs.locality = 0.1;
+  hubs.cost = 20;
+  RandomDagConfig chain = base;
+  chain.nodes = 3000;
+  chain.depth = 3000;
+  chain.fanIn = 1;
+  chain.leafFraction = 0;
+
+  for (const RandomDagConfig& config : {base, wide, hubs, chain}) {
+    const RandomDag dag(config);
+    const auto expected = dag.evaluate();
+    auto check = [&](TTaskScheduler& sched, const char* mode) {
+      for (size_t i = 0; i < dag.size(); ++i) {
+        ASSERT_EQ(sched.getResult<uint64_t>(i), expected[i]) << mode << ", node " << i;
+      }
+    };
+
+    TTaskScheduler seq;
+    dag.addTo(seq);
+    seq.executeAll();
+    EXPECT_EQ(seq.stats().executions, dag.size());
+    check(seq, "sequential");
+
+    TTaskScheduler par(3);
+    dag.addTo(par);
+    par.executeAll();
+    EXPECT_EQ(par.stats().executions, dag.size());
+    check(par, "parallel");
+
+    TTaskScheduler inc(3);
+    for (size_t c = 0; c < 5; ++c) {
+      dag.addTo(inc, dag.size() * c / 5, dag.size() * (c + 1) / 5);
+      inc.executeAll();
+    }
+    EXPECT_EQ(inc.stats().executions, dag.size());
+    check(inc, "incremental");
+
+    TTaskScheduler lazy(3);
+    dag.addTo(lazy);
+    EXPECT_EQ(lazy.getResult<uint64_t>(dag.size() - 1), expected.back());
+    EXPECT_LE(lazy.stats().executions, dag.size());
+    check(lazy, "lazy");
+  }
+}
+
+TEST(TaskScheduler, DeterministicScheduleReplay) {
+  RandomDagConfig config;
+  config.nodes = 3000;
+  config.depth = 30;
+  config.cost = 50;
+  config.seed = 11;
+  const RandomDag dag(config);
+  const auto expected = dag.evaluate();
+  using Schedule = TTaskScheduler::Schedule;
+
+  // Один и тот же порядок вызовов: ленивый getResult, затем executeAll.
+  auto run = [&](TTaskScheduler& sched) {
+    dag.addTo(sched);
+    EXPECT_EQ(sched.getResult<uint64_t>(dag.size() / 2), expected[dag.size() / 2]);
+    sched.executeAll();
+    for (size_t i = 0; i < dag.size(); ++i) ASSERT_EQ(sched.getResult<uint64_t>(i), expected[i]) << "node " << i;
+  };
+
+  TTaskScheduler original(3);
+  original.recordSchedule();
+  run(original);
+  const Schedule recorded = original.recordedSchedule();
+  ASSERT_EQ(recorded.steps.size(), dag.size());
+
+  const std::string path = testing::TempDir() + "task_scheduler_schedule.txt";
+  recorded.save(path);
+  Schedule loaded;
+  EXPECT_FALSE(loaded.load(path + ".missing"));
+  ASSERT_TRUE(loaded.load(path));
+  EXPECT_EQ(loaded.steps, recorded.steps);
+  std::remove(path.c_str());
+
+  TTaskScheduler replayed(3);
+  replayed.replaySchedule(loaded);
+  replayed.recordSchedule();
+  run(replayed);
+  EXPECT_EQ(replayed.recordedSchedule().steps, recorded.steps);
+  EXPECT_EQ(replayed.stats().unplanned, 0u);
+
+  auto seeded = [&](uint64_t seed) {
+    TTaskScheduler sched(3);
+    sched.randomSchedule(seed);
+    sched.recordSchedule();
+    run(sched);
+    return sched.recordedSchedule().steps;
+  };
+  const auto first = seeded(42);
+  EXPECT_EQ(seeded(42), first);
+  EXPECT_NE(seeded(43), first);
+
+  // Задачи, которых нет в расписании, выполняются как обычно.
+  TTaskScheduler extended(3);
+  extended.replaySchedule(recorded);
+  dag.addTo(extended);
+  const auto tail = extended.add([](uint64_t x) { return x + 1; }, extended.getFutureResult<uint64_t>(dag.size() - 1));
+  extended.executeAll();
+  EXPECT_EQ(extended.getResult<uint64_t>(tail), expected.back() + 1);
+  EXPECT_EQ(extended.stats().unplanned, 1u);
+}
+
+TEST(TaskScheduler, SubgraphAsCompositeTask) {
+  int builds = 0;
+  const Subgraph<double(double, double)> hypot([&builds](TTaskScheduler& g, FutureResult<double> a, FutureResult<double> b) {
+    ++builds;
+    auto square = [](double x) { return x * x; };
+    const auto a2 = g.add(square, a);
+    const auto b2 = g.add(square, b);
+    const auto sum = g.add([](double x, double y) { return x + y; }, g.getFutureResult<double>(a2),
+                           g.getFutureResult<double>(b2));
+    return g.getFutureResult<double>(g.add([](double x) { return std::sqrt(x); }, g.getFutureResult<double>(sum)));
+  });
+  EXPECT_EQ(hypot.size(), 6u);
+
+  for (size_t threads : {0, 2}) {
+    TTaskScheduler sched(threads);
+    const auto three = sched.add([] { return 3.0; });
+    std::vector<size_t> ids;
+    for (int i = 0; i < 16; ++i) ids.push_back(sched.add(hypot, sched.getFutureResult<double>(three), 4.0 + i));
+    sched.executeAll();
+    for (int i = 0; i < 16; ++i) EXPECT_DOUBLE_EQ(sched.getResult<double>(ids[i]), std::hypot(3.0, 4.0 + i));
+    EXPECT_EQ(sched.stats().executions, 17u) << "экземпляр подграфа — одна задача родителя";
+  }
+  EXPECT_EQ(builds, 1);
+
+  // Внутренние задачи экземпляра выполняются одновременно на пуле родителя.
+  std::atomic<int> started{0};
+  const Subgraph<bool(int)> overlap([&started](TTaskScheduler& g, FutureResult<int>) {
+    auto waitForBoth = [&started] {
+      ++started;
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+      while (started.load() < 2 && std::chrono::steady_clock::now() < deadline) std::this_thread::yield();
+      return started.load() == 2;
+    };
+    const auto x = g.add(waitForBoth);
+    const auto y = g.add(waitForBoth);
+    return g.add([](bool a, bool b) { return a && b; }, g.getFutureResult<bool>(x), g.getFutureResult<bool>(y));
+  });
+  {
+    TTaskScheduler sched(3);
+    EXPECT_TRUE(sched.getResult<bool>(sched.add(overlap, 0)));
+  }
+
+  // Подграф внутри подграфа, экземпляров больше, чем потоков: ждущие потоки помогают.
+  const Subgraph<int(int)> chain([](TTaskScheduler& g, FutureResult<int> in) {
+    size_t last = g.add([](int x) { return x + 1; }, in);
+    for (int k = 1; k < 20; ++k) last = g.add([](int x) { return x + 1; }, g.getFutureResult<int>(last));
+    return last;
+  });
+  const Subgraph<int(int)> twice([&chain](TTaskScheduler& g, FutureResult<int> in) {
+    const auto left = g.add(chain, in);
+    const auto right = g.add(chain, in);
+    return g.add([](int a, int b) { return a + b; }, g.getFutureResult<int>(left), g.getFutureResult<int>(right));
+  });
+  {
+    TTaskScheduler sched(2);
+    std::vector<size_t> ids;
+    for (int i = 0; i < 8; ++i) ids.push_back(sched.add(twice, i));
+    sched.executeAll();
+    for (int i = 0; i < 8; ++i) EXPECT_EQ(sched.getResult<int>(ids[i]), 2 * (i + 20));
+  }
+
+  const Subgraph<int(int)> failing([](TTaskScheduler& g, FutureResult<int> in) {
+    return g.add([](int x) -> int { throw std::runtime_error("body failed " + std::to_string(x)); }, in);
+  });
+  TTaskScheduler sched(2);
+  const auto id = sched.add(failing, 7);
+  EXPECT_THROW(sched.getResult<int>(id), std::runtime_error);
+}
+
+TEST(TaskScheduler, FixedPointNewtonRefinesRoots) {
+  const double a = 1, b = -2, c = 0;  // корни 0 и 2, как в тесте 1
+  int builds = 0;
+  std::atomic<int> steps{0};
+  const FixedPoint<double> newton(
+      [&](TTaskScheduler& g, FutureResult<double> x) {
+        ++builds;
+        const auto f = g.add([=, &steps](double v) { ++steps; return a * v * v + b * v + c; }, x);
+        const auto df = g.add([=](double v) { return 2 * a * v + b; }, x);
+        const auto delta = g.add([](double y, double d) { return y / d; }, g.getFutureResult<double>(f),
+                                 g.getFutureResult<double>(df));
+        return g.add([](double v, double d) { return v - d; }, x, g.getFutureResult<double>(delta));
+      },
+      [](double prev, double next) { return std::abs(next - prev) < 1e-12; }, 100);
+
+  const auto high = newton.run(5.0);
+  EXPECT_TRUE(high.converged);
+  EXPECT_NEAR(high.value, 2.0, 1e-12);
+  EXPECT_LT(high.iterations, 20u);
+  EXPECT_EQ(steps.load(), static_cast<int>(high.iterations)) << "одно выполнение тела на итерацию";
+  EXPECT_NEAR(newton(-3.0), 0.0, 1e-12);
+
+  const FixedPoint<double> capped(
+      [&](TTaskScheduler& g, FutureResult<double> x) { return g.add([](double v) { return v / 2 + 1; }, x); },
+      [](double, double) { return false; }, 7);
+  const auto limited = capped.run(0.0);
+  EXPECT_FALSE(limited.converged);
+  EXPECT_EQ(limited.iterations, 7u);
+  EXPECT_DOUBLE_EQ(limited.value, 2.0 - std::ldexp(2.0, -7));
+
+  // Цикл — одна задача родителя; на пуле тело выполняется на его потоках.
+  for (size_t threads : {0, 2}) {
+    TTaskScheduler sched(threads);
+    const auto guess = sched.add([] { return 3.0; });
+    const auto root = sched.add(newton, sched.getFutureResult<double>(guess));
+    const auto other = sched.add(newton, -1.0);
+    EXPECT_NEAR(sched.getResult<double>(root), 2.0, 1e-12);
+    EXPECT_NEAR(sched.getResult<double>(other), 0.0, 1e-12);
+    EXPECT_EQ(sched.stats().executions, 3u);
+  }
+  EXPECT_EQ(builds, 1);
+
+  // Состояние из нескольких переменных: (x, число шагов).
+  using State = std::pair<double, int>;
+  const FixedPoint<State> counted(
+      [](TTaskScheduler& g, FutureResult<State> s) {
+        return g.add([](const State& st) { return State{std::sqrt(st.first), st.second + 1}; }, s);
+      },
+      [](const State& prev, const State& next) { return std::abs(next.first - prev.first) < 1e-9; }, 1000);
+  const auto sqrtLimit = counted.run({256.0, 0});
+  EXPECT_TRUE(sqrtLimit.converged);
+  EXPECT_NEAR(sqrtLimit.value.first, 1.0, 1e-8);
+  EXPECT_EQ(sqrtLimit.value.second, static_cast<int>(sqrtLimit.iterations));
+
+  // Буфер результата итерации возвращается в пул тела и достаётся следующей итерации.
+  using Vec = std::vector<double>;
+  const FixedPoint<Vec> halve(
+      [](TTaskScheduler& g, FutureResult<Vec> v) {
+        return g.add([](BufferHandle buffers, const Vec& in) {
+          Vec out = buffers.acquire<double>(in.size());
+          for (size_t i = 0; i < in.size(); ++i) out[i] = in[i] / 2;
+          return out;
+        }, g.buffers(), v);
+      },
+      [](const Vec&, const Vec& next) { return next[0] < 1e-3; }, 100);
+  const auto halved = halve.run(Vec(4096, 1.0));
+  EXPECT_TRUE(halved.converged);
+  EXPECT_GT(halved.iterations, 5u);
+  const auto reuse = halve.bufferStats();
+  EXPECT_GE(reuse.hits, halved.iterations - 1);
+  EXPECT_LE(reuse.misses, 1u);
+}
+
+TEST(TaskScheduler, ParallelAlgorithmsMatchStd) {
+  struct Item {
+    int key;
+    int order;
+    bool operator==(const Item&) const = default;
+  };
+  auto byKey = [](const Item& a, const Item& b) { return a.key < b.key; };
+  auto bucket = [](int x) { return static_cast<size_t>(x + 1000) / 100; };
+  auto divisibleBy3 = [](int x) { return x % 3 == 0; };
+
+  for (size_t threads : {0, 3}) {
+    for (size_t n : {0, 1, 7, 1000, 100003}) {
+      std::mt19937 rng(static_cast<unsigned>(n));
+      std::vector<int> data(n);
+      for (int& x : data) x = static_cast<int>(rng() % 2000) - 1000;
+      std::vector<Item> items(n);
+      for (size_t i = 0; i < n; ++i) items[i] = {data[i] / 50, static_cast<int>(i)};
+
+      TTaskScheduler sched(threads);
+      const auto src = sched.getFutureResult<std::vector<int>>(sched.add([](const std::vector<int>& d) { return d; }, borrow(data)));
+      const auto scan = sched.add(ParallelScan<int>{.grain = 64}, src);
+      const auto exclusive = sched.add(ParallelScan<int>{.init = 5, .exclusive = true, .grain = 64}, src);
+      const auto sorted = sched.add(ParallelSort<int>{.grain = 64, .buffers = sched.buffers()}, src);
+      const auto radix = sched.add(ParallelRadixSort<int>{.grain = 64}, src);
+      const auto stable = sched.add(ParallelSort<Item, decltype(byKey)>{.comp = byKey, .grain = 64}, borrow(items));
+      const auto hist = sched.add(ParallelHistogram<int, decltype(bucket)>{.bins = 20, .key = bucket, .grain = 64}, src);
+      const auto part = sched.add(StablePartition<int, decltype(divisibleBy3)>{.pred = divisibleBy3, .grain = 64}, src);
+      sched.executeAll();
+
+      std::vector<int> expected(n);
+      std::inclusive_scan(data.begin(), data.end(), expected.begin());
+      EXPECT_EQ(sched.getResult<std::vector<int>>(scan), expected) << n;
+      std::exclusive_scan(data.begin(), data.end(), expected.begin(), 5);
+      EXPECT_EQ(sched.getResult<std::vector<int>>(exclusive), expected) << n;
+
+      expected = data;
+      std::sort(expected.begin(), expected.end());
+      EXPECT_EQ(sched.getResult<std::vector<int>>(sorted), expected) << n;
+      EXPECT_EQ(sched.getResult<std::vector<int>>(radix), expected) << n;
+      std::vector<Item> stableExpected = items;
+      std::stable_sort(stableExpected.begin(), stableExpected.end(), byKey);
+      EXPECT_EQ(sched.getResult<std::vector<Item>>(stable), stableExpected) << n;
+
+      std::vector<uint64_t> counts(20);
+      for (int x : data) ++counts[bucket(x)];
+      EXPECT_EQ(sched.getResult<std::vector<uint64_t>>(hist), counts) << n;
+
+      expected = data;
+      const auto mid = std::stable_partition(expected.begin(), expected.end(), divisibleBy3);
+      const auto partitioned = sched.getResult<Partitioned<int>>(part);
+      EXPECT_EQ(partitioned.values, expected) << n;
+      EXPECT_EQ(partitioned.split, static_cast<size_t>(mid - expected.begin())) << n;
+    }
+  }
+
+  // Беззнаковые ключи на всю ширину типа.
+  std::vector<uint64_t> wide(50000);
+  std::mt19937_64 rng(5);
+  for (auto& x : wide) x = rng();
+  TTaskScheduler sched(3);
+  const auto radix = sched.add(ParallelRadixSort<uint64_t>{.grain = 1000}, borrow(wide));
+  std::sort(wide.begin(), wide.end());
+  EXPECT_EQ(sched.getResult<std::vector<uint64_t>>(radix), wide);
+
+  auto narrow = [](int x) { return static_cast<size_t>(x); };
+  const auto bad = sched.add(ParallelHistogram<int, decltype(narrow)>{.bins = 10, .key = narrow, .grain = 16},
+                             std::vector<int>(1000, 3));
+  EXPECT_EQ(sched.getResult<std::vector<uint64_t>>(bad)[3], 1000u);
+  const auto outOfRange = sched.add(ParallelHistogram<int, decltype(narrow)>{.bins = 3, .key = narrow, .grain = 16},
+                                    std::vector<int>(1000, 3));
+  EXPECT_THROW(sched.getResult<std::vector<uint64_t>>(outOfRange), std::out_of_range);
+
+  // Узлов больше, чем потоков: ожидающие куски потоки помогают друг другу.
+  TTaskScheduler small(2);
+  std::vector<int> big(200000);
+  std::iota(big.rbegin(), big.rend(), 0);
+  std::vector<size_t> sorts;
+  for (int i = 0; i < 8; ++i) sorts.push_back(small.add(ParallelSort<int>{.grain = 1000}, borrow(big)));
+  small.executeAll();
+  std::vector<int> ascending(big.size());
+  std::iota(ascending.begin(), ascending.end(), 0);
+  for (size_t id : sorts) EXPECT_EQ(small.getResult<std::vector<int>>(id), ascending);
+}
+
+TEST(TaskScheduler, GraphCompilerMatchesScheduler) {
+  const GraphDescription g = GraphDescription::load(std::string(GRAPH_EXAMPLES_DIR) + "/quadratic.graph");
+  std::vector<std::string> order;
+  for (const auto& n : g.nodes) order.push_back(n.name);
+  EXPECT_EQ(order, (std::vector<std::string>{"v", "d", "up", "down", "x1", "x2", "x3"}));
+  EXPECT_EQ(g.nodes[2].level, g.nodes[3].level);
+
+  KernelRegistry registry;
+  registry.add("minus4ac", quadratic_kernels::minus4ac);
+  registry.add("discriminant", quadratic_kernels::discriminant);
+  registry.add("rootPlus", quadratic_kernels::rootPlus);
+  registry.add("rootMinus", quadratic_kernels::rootMinus);
+  registry.add("divide2a", quadratic_kernels::divide2a);
+  registry.add<float(float)>("plus3", [](float v) { return v + 3; });
+
+  for (const auto& [a, b, c] : {std::array<float, 3>{1, -2, 1}, std::array<float, 3>{1, -5, 6}}) {
+    TTaskScheduler sched(2);
+    const std::vector<size_t> inputs{sched.add([a] { return a; }), sched.add([b] { return b; }),
+                                     sched.add([c] { return c; })};
+    const auto outputs = addGraph(sched, g, registry, inputs);
+    ASSERT_EQ(outputs.size(), 3u);
+
+    const quadratic_outputs direct = quadratic(a, b, c);
+    const quadratic_parallel_outputs parallel = quadratic_parallel(a, b, c);
+    const auto packed = sched.add([a, b, c] { return quadratic_task::inputs{a, b, c}; });
+    const auto composite = sched.add(quadratic_task{}, sched.getFutureResult<quadratic_task::inputs>(packed));
+    const auto whole = sched.getResult<quadratic_outputs>(composite);
+
+    const float expected[] = {sched.getResult<float>(outputs[0]), sched.getResult<float>(outputs[1]),
+                              sched.getResult<float>(outputs[2])};
+    for (const quadratic_outputs& r : {direct, whole}) {
+      EXPECT_FLOAT_EQ(r.x1, expected[0]);
+      EXPECT_FLOAT_EQ(r.x2, expected[1]);
+      EXPECT_FLOAT_EQ(r.x3, expected[2]);
+    }
+    EXPECT_FLOAT_EQ(parallel.x1, expected[0]);
+    EXPECT_FLOAT_EQ(parallel.x2, expected[1]);
+    EXPECT_FLOAT_EQ(parallel.x3, expected[2]);
+  }
+  EXPECT_FLOAT_EQ(quadratic(1, -5, 6).x1, 3);
+  EXPECT_FLOAT_EQ(quadratic(1, -5, 6).x3, 6);
+
+  // Два входа — композитная задача принимает их прямо, узлы объявлены не по порядку.
+  std::istringstream small(
+      "graph sum\n"
+      "kernel add : float(float, float) = quadratic_kernels::discriminant\n"
+      "node z = add(x, y2)\n"
+      "node y2 = add(x, y)\n"
+      "input x : float\n"
+      "input y : float\n"
+      "output z\n");
+  const std::string code = compileGraph(GraphDescription::parse(small));
+  EXPECT_NE(code.find("inline float sum(const float& x, const float& y)"), std::string::npos);
+  EXPECT_NE(code.find("float operator()(const float& x, const float& y) const"), std::string::npos);
+  EXPECT_LT(code.find("const float y2 ="), code.find("const float z ="));
+  EXPECT_EQ(code.find("std::async"), std::string::npos);
+
+  auto fails = [](const std::string& text, const std::string& what) {
+    std::istringstream in("graph bad\nkernel k : int(int) = f\ninput i : int\n" + text);
+    try {
+      GraphDescription::parse(in);
+    } catch (const std::runtime_error& e) {
+      EXPECT_NE(std::string(e.what()).find(what), std::string::npos) << e.what();
+      return;
+    }
+    ADD_FAILURE() << "no error for: " << text;
+  };
+  fails("node n = missing(i)\noutput n\n", "line 4: unknown kernel 'missing'");
+  fails("input s : float\nnode n = k(s)\noutput n\n", "line 5: argument 's' is float");
+  fails("node n = k(i, i)\noutput n\n", "takes 1 arguments");
+  fails("node p = k(q)\nnode q = k(p)\noutput q\n", "cyclic dependency");
+  fails("node n = k(i)\noutput m\n", "line 5: unknown output 'm'");
+  fails("kernel wide : int(int, int, int) = f\n", "line 4: kernel 'wide' has more than 2 parameters");
+  fails("node n = k(i)\n", "missing 'output'");
+  fails("nod n = k(i)\n", "line 4: unknown declaration 'nod'");
+}